@@ -2,8 +2,8 @@
 
 #include "Cloth.h"
 
-#include "Image/tImage.h"
-#include "Math/Random.h"
+#include "ClothLod.h"
+#include "DistCloth.h"
 
 // OpenGL
 #include "GL/glew.h"
@@ -11,12 +11,10 @@
 // This needs to come after GLEW
 #include "GL/freeglut.h"
 
-#include <execution>
-
 Cloth::Cloth() { Cloth(40, 40, 1.0f, 1.0f, f3vec(0, 0, 0), .01f, 0.9f, TABLECLOTH); }
 
-Cloth::Cloth(int nx, int ny, float dx, float dy, const f3vec& clothCenter_, float timestep, float damping, ClothStyle clothStyle) :
-    m_nx(nx), m_ny(ny), m_restDX(dx), m_restDY(dy), m_initClothCenter(clothCenter_), m_timeStep(timestep), m_damping(damping)
+Cloth::Cloth(int nx, int ny, float dx, float dy, const f3vec& clothCenter_, float timestep, float damping, ClothStyle clothStyle, unsigned seed) :
+    m_nx(nx), m_ny(ny), m_restDX(dx), m_restDY(dy), m_initClothCenter(clothCenter_), m_timeStep(timestep), m_damping(damping), m_seed(seed)
 {
     int numParticles = nx * ny;
     m_numTris = 2 * (nx - 1) * (ny - 1);
@@ -25,25 +23,46 @@ Cloth::Cloth(int nx, int ny, float dx, float dy, const f3vec& clothCenter_, floa
     // Create cloth node points and constraints
     m_pos.resize(numParticles);
     m_oldPos.resize(numParticles);
-    m_forceAcc.resize(numParticles);
     m_triInds.resize(m_numTris);
     m_texCoords.resize(numParticles);
-    m_normals.resize(numParticles);
     Reset(clothStyle);
 
     // Create colliders
     CreateSpheres();
     CreateBoxes();
-
-    // Read texture
-    ReadTexture("PatternCloth.jpg");
 }
 
 Cloth::~Cloth() {}
 
+// Pins on the top row, whose positions are given by pos
+static void AddStyleConstraints(ClothConstraints& cons, const f3vec* pos, int nx, ClothStyle clothStyle)
+{
+    const int ALL_AXES = CX_AXIS | CY_AXIS | CZ_AXIS;
+
+    // Constraints for curtain-like behavior
+    if (clothStyle == CURTAIN) {
+        for (int i = 0; i < nx; i += 4) cons.pins.push_back({i, pos[i], ALL_AXES}); // Constrain top of cloth to X axis
+    } else if (clothStyle == SLIDING_CURTAIN) {
+        for (int i = 0; i < nx; i += 4) {
+            if (i == 0)
+                cons.pins.push_back({i, pos[i], ALL_AXES}); // Fix top-left corner particle to initial position
+            else
+                cons.sliders.push_back({i, pos[i], CY_AXIS | CZ_AXIS}); // Let top particles slide in X
+        }
+    } else if (clothStyle == PLEATED_CURTAIN) {
+        for (int i = 0; i < nx; i += 10) {
+            f3vec tgt = pos[i];
+            tgt.x *= 0.7f;                           // Shrink X coords to cause pleating
+            cons.pins.push_back({i, tgt, ALL_AXES}); // Constrain top of cloth to X axis
+        }
+    }
+}
+
 void Cloth::Reset(ClothStyle clothStyle)
 {
-    m_constraints.clear();
+    m_clothStyle = clothStyle;
+    m_posStale = m_oldPosStale = false; // Overwritten below
+    m_constraints.Clear();
 
     // Find width and height of cloth
     float width = m_nx * m_restDX;
@@ -59,61 +78,11 @@ void Cloth::Reset(ClothStyle clothStyle)
         }
     }
 
-    // Constraints to hold the cloth together
-    for (int j = 0; j < m_ny; j++) {
-        for (int i = 0; i < m_nx; i++) {
-            f3vec* p1 = m_pos.data() + i + m_nx * j;           // Index point
-            f3vec* p2 = m_pos.data() + i + 1 + m_nx * j;       // P1---p2
-            f3vec* p3 = m_pos.data() + i + m_nx * (j + 1);     //  |    |
-            f3vec* p4 = m_pos.data() + i + 1 + m_nx * (j + 1); // P3---p4
-
-            if (i < m_nx - 1) m_constraints.push_back(new RodConstraint(p1, p2, m_restDX));                  // Horizontal springs
-            if (j < m_ny - 1) m_constraints.push_back(new RodConstraint(p1, p3, m_restDY));                  // Vertical springs
-            if (i < m_nx - 1 && j < m_ny - 1) m_constraints.push_back(new RodConstraint(p1, p4, restDDiag)); // Diagonal springs are faster with
-            if (i < m_nx - 1 && j < m_ny - 1) m_constraints.push_back(new RodConstraint(p2, p3, restDDiag)); // Only one but it sags to the left
-        }
-    }
-
-    // Stiffening constraints
-    const int ST = m_stiffening;
-    if (ST > 1)
-        for (int j = 0; j < m_ny; j++) {
-            for (int i = 0; i < m_nx; i++) {
-                f3vec* p1 = m_pos.data() + i + m_nx * j;             // Index point
-                f3vec* p2 = m_pos.data() + i + ST + m_nx * j;        // P1---p2
-                f3vec* p3 = m_pos.data() + i + m_nx * (j + ST);      //  |    |
-                f3vec* p4 = m_pos.data() + i + ST + m_nx * (j + ST); // P3---p4
-
-                if (i < m_nx - ST) m_constraints.push_back(new RodConstraint(p1, p2, m_restDX * ST));                   // Horizontal springs
-                if (j < m_ny - ST) m_constraints.push_back(new RodConstraint(p1, p3, m_restDY * ST));                   // Vertical springs
-                if (i < m_nx - ST && j < m_ny - ST) m_constraints.push_back(new RodConstraint(p1, p4, restDDiag * ST)); // Diagonal springs are faster with
-                if (i < m_nx - ST && j < m_ny - ST) m_constraints.push_back(new RodConstraint(p2, p3, restDDiag * ST)); // Only one but it sags to the left
-            }
-        }
-
-    // Constraints for curtain-like behavior
-    if (clothStyle == CURTAIN) {
-        for (int i = 0; i < m_nx; i += 4) {
-            f3vec* p1 = &m_pos[i];
-            m_constraints.push_back(new PointConstraint(p1, *p1)); // Constrain top of cloth to X axis
-        }
-    } else if (clothStyle == SLIDING_CURTAIN) {
-        for (int i = 0; i < m_nx; i += 4) {
-            if (i == 0)
-                m_constraints.push_back(new PointConstraint(&m_pos[i], m_pos[i])); // Fix top-left corner particle to initial position
-            else
-                m_constraints.push_back(new SlideConstraint(&m_pos[i], m_pos[i], (ConstrainAxis)(CY_AXIS | CZ_AXIS))); // Let top particles slide in X
-        }
-    } else if (clothStyle == PLEATED_CURTAIN) {
-        for (int i = 0; i < m_nx; i += 10) {
-            f3vec tgt = m_pos[i];
-            tgt.x *= 0.7f;                                                // Shrink X coords to cause pleating
-            m_constraints.push_back(new PointConstraint(&m_pos[i], tgt)); // Constrain top of cloth to X axis
-        }
-    }
-
-    // Shuffle constraints by swapping each one with another random one
-    for (int i = 0; i < m_constraints.size(); i++) std::swap(m_constraints[i], m_constraints[irand((int)m_constraints.size())]);
+    // Reseeding makes every reset shuffle the constraints the same way, which the distributed workers rely on to match
+    m_rng.seed(m_seed);
+    AddGridConstraints(m_constraints, m_nx, m_ny, m_restDX, m_restDY, m_stiffening);
+    AddStyleConstraints(m_constraints, m_pos.data(), m_nx, clothStyle);
+    m_constraints.Shuffle(m_rng);
 
     // Create triangle indices for rendering
     int index = 0;
@@ -123,86 +92,109 @@ void Cloth::Reset(ClothStyle clothStyle)
             m_triInds[index++] = {i + j * m_nx, i + 1 + (j + 1) * m_nx, i + 1 + j * m_nx};
         }
     }
+
+    m_renderer.SetTopology(m_nx, m_ny, m_triInds, m_texCoords);
+
+    if (m_dist) {
+        InitWorkers();
+    } else {
+        if (m_lod) RefineLod(); // The pins may have moved
+        RebuildSolver();
+    }
 }
 
-void Cloth::VerletIntegration()
+void Cloth::InitWorkers()
 {
-    // Parallelizing this didn't really help. Remove par_unseq if not C++17.
-    std::for_each(std::execution::par_unseq, m_pos.begin(), m_pos.end(), [&](f3vec const& p) {
-        int i = &p - &m_pos[0];
-        f3vec& x = m_pos[i];
-        f3vec temp = x;
-        f3vec& oldx = m_oldPos[i];
-        f3vec& a = m_forceAcc[i];
-
-        // Verlet integration: x - oldx is an approximation of velocity.
-        x += (x - oldx) * m_damping + a * m_timeStep * m_timeStep;
-        oldx = temp;
-    });
+    // Workers build their own rods, but take the pins from m_constraints, so this can restart them in the middle of a simulation
+    DistClothParams params = {m_nx, m_ny, m_restDX, m_restDY, m_timeStep, m_damping, m_gravity, m_stiffening, m_precision, m_seed};
+    m_dist->Init(params, m_constraints, m_pos, m_oldPos);
 }
 
-void Cloth::SatisfyConstraints()
+void Cloth::RebuildSolver()
 {
-    // Apply all the constraints several times per time step to try to find a mutually satisfactory position for each particle
-    // More iterations makes the simulation much more accurate, such as making the cloth pleat properly.
-    for (int j = 0; j < m_constraintItersPerTimeStep; j++) {
-        if (m_collisionObj == COLLIDE_SPHERES)
-            CollisionWithSpheres();
-        else if (m_collisionObj == COLLIDE_BOXES || m_collisionObj == COLLIDE_INSIDE_BOXES)
-            CollisionWithBoxes();
-
-        // This parallelization has a race condition for Rod constraints, since multiple threads could touch the same particle at the same time,
-        // but in practice it just doesn't matter.
-        std::for_each(std::execution::par_unseq, m_constraints.begin(), m_constraints.end(), [&](Constraint* const& cc) { cc->Apply(); });
-
-        std::for_each(std::execution::par_unseq, m_grabConstraints.begin(), m_grabConstraints.end(), [&](Constraint* const& cc) { cc->Apply(); });
+    // Picks up wherever m_pos and m_oldPos are, so this can switch solvers in the middle of a simulation
+    SyncState(true);
+    if (m_lod) {
+        // Keeps m_lod's refinement as it is; that only changes on the LodTimeStep() schedule or through RefineLod().
+        // Particles that become simulated start out on the reconstructed surface, moving with it, so switching levels doesn't jolt the cloth.
+        m_lod->Build(m_constraints, m_stiffening, m_pos, m_oldPos, m_simConstraints, m_simPos, m_simOldPos, m_rng);
     }
-}
 
-void Cloth::AccumulateForces()
-{
-    // All particles are affected by gravity; could put other forces here, too
-    for (int i = 0; i < m_pos.size(); i++) { m_forceAcc[i] = m_gravity; }
+    const ClothConstraints& cons = m_lod ? m_simConstraints : m_constraints;
+    m_solver.reset(MakeClothSolver(m_precision, ClothSolverFeatures(cons, m_collisionObj)));
+    m_solver->SetConstraints(cons);
+    if (m_lod)
+        m_solver->Bind(m_simPos, m_simOldPos);
+    else
+        m_solver->Bind(m_pos, m_oldPos);
 }
 
-void Cloth::CollisionWithSpheres()
+void AddGridConstraints(ClothConstraints& cons, int nx, int ny, float dx, float dy, int stiffening)
 {
-    // Collide each particle with each sphere
-    for (int i = 0; i < m_pos.size(); i++) {
-        for (size_t j = 0; j < m_collisionSpheres.size(); j++) {
-            f3vec spherePos(m_collisionSpheres[j]);
-            float sphereRad = m_collisionSpheres[j].w;
-            f3vec V = m_pos[i] - spherePos;
-            float lengthV = V.length();
-
-            // If the particle is inside the sphere push it to the nearest point outside the sphere
-            if (lengthV < sphereRad) m_pos[i] = spherePos + V * (sphereRad / lengthV);
+    float dDiag = sqrt(dx * dx + dy * dy);
+
+    // Constraints to hold the cloth together
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            int p1 = i + nx * j;           // Index point
+            int p2 = i + 1 + nx * j;       // P1---p2
+            int p3 = i + nx * (j + 1);     //  |    |
+            int p4 = i + 1 + nx * (j + 1); // P3---p4
+
+            if (i < nx - 1) cons.rods.push_back({p1, p2, dx});                  // Horizontal springs
+            if (j < ny - 1) cons.rods.push_back({p1, p3, dy});                  // Vertical springs
+            if (i < nx - 1 && j < ny - 1) cons.rods.push_back({p1, p4, dDiag}); // Diagonal springs are faster with
+            if (i < nx - 1 && j < ny - 1) cons.rods.push_back({p2, p3, dDiag}); // Only one but it sags to the left
         }
     }
+
+    // Stiffening constraints
+    const int ST = stiffening;
+    if (ST > 1)
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                int p1 = i + nx * j;             // Index point
+                int p2 = i + ST + nx * j;        // P1---p2
+                int p3 = i + nx * (j + ST);      //  |    |
+                int p4 = i + ST + nx * (j + ST); // P3---p4
+
+                if (i < nx - ST) cons.stiffRods.push_back({p1, p2, dx * ST});                  // Horizontal springs
+                if (j < ny - ST) cons.stiffRods.push_back({p1, p3, dy * ST});                  // Vertical springs
+                if (i < nx - ST && j < ny - ST) cons.stiffRods.push_back({p1, p4, dDiag * ST}); // Diagonal springs are faster with
+                if (i < nx - ST && j < ny - ST) cons.stiffRods.push_back({p2, p3, dDiag * ST}); // Only one but it sags to the left
+            }
+        }
 }
 
-void Cloth::CollisionWithBoxes()
+unsigned ClothSolverFeatures(const ClothConstraints& cons, CollisionObjects collObj)
 {
-    bool checkInside = m_collisionObj == COLLIDE_INSIDE_BOXES;
-    // Collide each particle with each AABB and make sure the particle is on the proper side of the box
-    size_t st = 1, end = m_collisionBoxes.size();
-    if (checkInside) {
-        st = 0;
-        end = 1;
-    }
+    static const SolverCollider colliders[NUM_COLLISION_OBJECTS] = {SOLVER_COLLIDE_SPHERES, SOLVER_COLLIDE_BOXES, SOLVER_COLLIDE_INSIDE_BOX};
+    return cons.Features() | (colliders[collObj] << FEAT_COLLIDER_SHIFT);
+}
 
-    for (size_t j = st; j < end; j++) {
-        for (int i = 0; i < m_pos.size(); i++) {
-            // If forcing outside and the particle is inside the box push it to the nearest point on the box surface
-            if (m_collisionBoxes[j].contains(m_pos[i]) && !checkInside) m_pos[i] = m_collisionBoxes[j].nearestOnSurface(m_pos[i]);
-            // If forcing inside and the particle is outside the box push it to the nearest point on the box surface
-            if (!m_collisionBoxes[j].contains(m_pos[i]) && checkInside) m_pos[i] = m_collisionBoxes[j].nearest(m_pos[i]);
-        }
-    }
+void Cloth::SetCollideObjectType(CollisionObjects collObj)
+{
+    m_collisionObj = collObj;
+    if (m_dist) return;
+    if (m_lod) RefineLod();
+    RebuildSolver();
+}
+
+void Cloth::SetPrecision(SolverPrecision precision)
+{
+    m_precision = precision;
+    if (m_dist) {
+        SyncState(true); // Workers pick up where they left off, just in the new precision
+        InitWorkers();
+    } else
+        RebuildSolver();
 }
 
-void Cloth::SetCollideObjectType(CollisionObjects collObj) { m_collisionObj = collObj; }
 void Cloth::SetConstraintIters(int iters) { m_constraintItersPerTimeStep = iters; }
+void Cloth::SetParallel(bool parallel) { m_parallel = parallel; }
+void Cloth::SetSpheres(const std::vector<f4vec>& spheres) { m_collisionSpheres = m_prevSpheres = spheres; }
+void Cloth::SetBoxes(const std::vector<Aabb>& boxes) { m_collisionBoxes = m_prevBoxes = boxes; }
+void Cloth::SetContinuousCollision(bool sweep) { m_continuousCollision = sweep; }
 void Cloth::SetStiffening(int stif, ClothStyle clothStyle)
 {
     m_stiffening = stif;
@@ -245,90 +237,220 @@ void Cloth::MoveColliders(const f3vec& delta)
 
 void Cloth::GrabParticles(const f3vec& pt)
 {
-    for (auto p : m_grabConstraints) delete p;
-    m_grabConstraints.clear();
+    SyncState(false);
+    m_grabs.clear();
 
     for (size_t i = 0; i < m_pos.size(); i++) {
-        f3vec& p = m_pos[i];
-        if ((p - pt).length() < restDDiag) m_grabConstraints.emplace_back(new PointConstraint(&p, p));
+        const f3vec& p = m_pos[i];
+        if ((p - pt).length() < restDDiag) m_grabs.push_back({(int)i, p});
     }
-}
 
-void Cloth::UngrabParticles()
-{
-    for (auto p : m_grabConstraints) delete p;
-    m_grabConstraints.clear();
+    // Grabbed particles have to be simulated right away, not at the next scheduled refinement
+    if (m_lod && !m_grabs.empty() && RefineLod()) RebuildSolver();
 }
 
+void Cloth::UngrabParticles() { m_grabs.clear(); }
+
 // Add up forces, advance system, satisfy constraints
 void Cloth::TimeStep()
 {
-    // Cumulative times with no par_unseq: AccumulateForces: 0.0456733 VerletIntegration: 0.193743 SatisfyConstraints: 11.9977
     AccumulateForces();
-    VerletIntegration();
-    SatisfyConstraints();
+
+    if (m_dist) {
+        DistributedTimeStep();
+    } else if (m_lod) {
+        LodTimeStep();
+    } else {
+        SolverStep step = {m_timeStep, m_damping, m_gravity, m_constraintItersPerTimeStep, m_parallel, &m_collisionSpheres, &m_collisionBoxes, &m_grabs,
+                           m_continuousCollision, &m_prevSpheres, &m_prevBoxes, m_forceAcc.empty() ? nullptr : &m_forceAcc};
+        m_solver->Step(step, nullptr);
+        m_posStale = m_oldPosStale = true;
+    }
+
+    // MoveColliders() between now and the next step is swept from here
+    m_prevSpheres = m_collisionSpheres;
+    m_prevBoxes = m_collisionBoxes;
 }
 
-void Cloth::MoveGrabbedParticles(const f3vec& delta)
+void Cloth::AccumulateForces()
 {
-    for (auto& c : m_grabConstraints) { c->setPos(c->getPos() + delta); }
+    // All particles are affected by gravity, which the solver applies uniformly; other forces, e.g. wind, could go here, as accelerations
+    m_forceAcc.clear();
 }
 
-void Cloth::Display(DrawMode drawMode)
+void Cloth::LodTimeStep()
 {
-    if (drawMode == DRAW_POINTS) {
-        glPointSize(3.0);
-        glColor3f(0, 1, 1);
-
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glVertexPointer(3, GL_FLOAT, 0, m_pos.data());
-        glDrawArrays(GL_POINTS, 0, (GLsizei)m_pos.size());
-        glDisableClientState(GL_VERTEX_ARRAY);
-    } else if (drawMode == DRAW_LINES) {
-        glLineWidth(2.5f);
-        glColor3f(1, 1, 1);
-        glEnableClientState(GL_VERTEX_ARRAY);
-        for (int i = 0; i < m_nx - 1; i++) {
-            glVertexPointer(3, GL_FLOAT, m_ny * sizeof(f3vec), &m_pos[i]);
-            glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)m_ny);
-        }
-        glDisableClientState(GL_VERTEX_ARRAY);
-    } else if (drawMode == DRAW_TRIS) {
-        glColor3f(1, 1, 1);
-        glEnable(GL_LIGHT0);
-        glEnable(GL_LIGHTING);
-        glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
-        glEnable(GL_TEXTURE_2D);
-        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-        glBindTexture(GL_TEXTURE_2D, m_texID);
-
-        for (int i = 0; i < m_numTris; i++) {
-            f3vec &a = m_pos[m_triInds[i][0]], &b = m_pos[m_triInds[i][1]], &c = m_pos[m_triInds[i][2]];
-            f3vec n1 = cross((c - b), (a - b));
-            n1.normalize();
-            m_normals[m_triInds[i][0]] = n1; // Computing facet normals but using them as vertex normals because glDrawElements requires vertex normals
-            m_normals[m_triInds[i][1]] = n1; // Most normals get written to three times, but no big deal.
-            m_normals[m_triInds[i][2]] = n1; // Could average them to get higher quality normals but not worth it.
+    // Every so often move the refinement to wherever the colliders, grabs, and folds have gone
+    if (++m_lodStepCount >= m_lodUpdateInterval) {
+        m_lodStepCount = 0;
+        SyncState(true);
+        if (m_lod->UpdateRefinement(m_pos, m_oldPos, m_lodUpdateInterval, m_collisionObj, m_collisionSpheres, m_collisionBoxes, m_grabs, m_constraints))
+            RebuildSolver();
+    }
+
+    m_simGrabs.clear();
+    for (const GrabPin& g : m_grabs)
+        if (m_lod->SimIndex(g.index) >= 0) m_simGrabs.push_back({m_lod->SimIndex(g.index), g.pos});
+
+    m_simForces.resize(m_forceAcc.empty() ? 0 : m_lod->NumSimulated());
+    for (size_t i = 0; i < m_forceAcc.size(); i++)
+        if (m_lod->SimIndex((int)i) >= 0) m_simForces[m_lod->SimIndex((int)i)] = m_forceAcc[i];
+
+    SolverStep step = {m_timeStep, m_damping, m_gravity, m_constraintItersPerTimeStep, m_parallel, &m_collisionSpheres, &m_collisionBoxes, &m_simGrabs,
+                       m_continuousCollision, &m_prevSpheres, &m_prevBoxes, m_simForces.empty() ? nullptr : &m_simForces};
+    m_solver->Step(step, nullptr);
+    m_posStale = m_oldPosStale = true; // The full grid is only reconstructed when something looks at it
+}
+
+bool Cloth::RefineLod()
+{
+    SyncState(true);
+    return m_lod->Refine(m_pos, m_oldPos, m_lodUpdateInterval, m_collisionObj, m_collisionSpheres, m_collisionBoxes, m_grabs, m_constraints);
+}
+
+void Cloth::SetLod(int stride)
+{
+    if (m_dist) {
+        printf("WARNING: level of detail isn't supported for a distributed cloth; simulating every particle.\n");
+        return;
+    }
+
+    SyncState(true); // While the solver and m_lod still match
+    m_lod.reset(stride > 1 ? new ClothLod(m_nx, m_ny, m_restDX, m_restDY, stride) : nullptr);
+    m_lodStepCount = 0;
+    if (m_lod) RefineLod();
+    RebuildSolver();
+}
+
+void Cloth::SetDistributed(int numWorkers, TransportKind kind, const char* exeName)
+{
+    if (m_lod) {
+        printf("WARNING: level of detail isn't supported for a distributed cloth; simulating every particle.\n");
+        m_lod.reset();
+    }
+    m_dist.reset(new DistCloth(numWorkers, kind, exeName));
+    Reset(m_clothStyle);
+}
+
+void Cloth::DistributedTimeStep()
+{
+    // The workers own the particles; this process just owns the colliders and grabs, and only gathers positions when something reads them
+    m_dist->Step(m_constraintItersPerTimeStep, m_parallel, m_collisionObj, m_continuousCollision, m_collisionSpheres, m_prevSpheres, m_collisionBoxes,
+                 m_prevBoxes, m_grabs, m_forceAcc);
+    m_posStale = m_oldPosStale = true;
+}
+
+void Cloth::SyncState(bool oldPosToo)
+{
+    if (!m_posStale && !(oldPosToo && m_oldPosStale)) return;
+
+    if (m_dist) {
+        m_dist->Gather(m_pos, oldPosToo ? &m_oldPos : nullptr);
+    } else {
+        m_solver->Sync(); // Free for float solvers, which step the bound vectors in place
+        if (m_lod) {
+            // The old positions are reconstructed too, so the surface's velocity carries over to particles that get refined later
+            if (m_posStale) m_lod->Reconstruct(m_simPos, m_pos, m_parallel);
+            if (oldPosToo && m_oldPosStale) m_lod->Reconstruct(m_simOldPos, m_oldPos, m_parallel);
         }
+    }
+    m_posStale = false;
+    if (oldPosToo) m_oldPosStale = false;
+}
 
-        glTexCoordPointer(2, GL_FLOAT, 0, m_texCoords.data());
-        glNormalPointer(GL_FLOAT, 0, m_normals.data());
-        glVertexPointer(3, GL_FLOAT, 0, m_pos.data());
+void Cloth::MoveGrabbedParticles(const f3vec& delta)
+{
+    for (auto& g : m_grabs) { g.pos += delta; }
+}
 
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glEnableClientState(GL_VERTEX_ARRAY);
+void Cloth::MeasureStretch(float& meanErr, float& maxErr)
+{
+    SyncState(false);
 
-        glDrawElements(GL_TRIANGLES, (GLsizei)m_triInds.size() * 3, GL_UNSIGNED_INT, m_triInds.data());
+    // Relative length error of the horizontal and vertical rods; zero when the cloth is at rest length everywhere
+    double sumErr = 0;
+    int count = 0;
+    maxErr = 0;
+    for (int j = 0; j < m_ny; j++) {
+        for (int i = 0; i < m_nx; i++) {
+            const f3vec& p1 = m_pos[i + m_nx * j];
+            if (i < m_nx - 1) {
+                float err = fabs((m_pos[i + 1 + m_nx * j] - p1).length() - m_restDX) / m_restDX;
+                sumErr += err;
+                maxErr = std::max(maxErr, err);
+                count++;
+            }
+            if (j < m_ny - 1) {
+                float err = fabs((m_pos[i + m_nx * (j + 1)] - p1).length() - m_restDY) / m_restDY;
+                sumErr += err;
+                maxErr = std::max(maxErr, err);
+                count++;
+            }
+        }
+    }
+    meanErr = count ? (float)(sumErr / count) : 0.f;
+}
+
+float Cloth::MeanSpeed()
+{
+    SyncState(true);
+
+    // Verlet keeps velocity implicitly as the last position change; a small value means the cloth has settled
+    double sum = 0;
+    for (size_t i = 0; i < m_pos.size(); i++) sum += (m_pos[i] - m_oldPos[i]).length();
+    return m_pos.empty() ? 0.f : (float)(sum / m_pos.size() / m_timeStep);
+}
 
-        glDisableClientState(GL_VERTEX_ARRAY);
-        glDisableClientState(GL_NORMAL_ARRAY);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+float Cloth::MeasurePenetration()
+{
+    SyncState(true);
 
-        glDisable(GL_TEXTURE_2D);
-        glDisable(GL_LIGHTING);
+    // The last step's path of each particle is m_oldPos to m_pos. It counts if it ends inside a collider, or if it went in and back out
+    // during the step, i.e. tunneled. Resting contact sits on the surface, so only going deeper than a tenth of a rod counts.
+    float slop = 0.1f * std::min(m_restDX, m_restDY);
+    int count = 0;
+    for (size_t i = 0; i < m_pos.size(); i++) {
+        f3vec a = m_oldPos[i], d = m_pos[i] - a;
+        bool in = false;
+        if (m_collisionObj == COLLIDE_SPHERES) {
+            for (const f4vec& s : m_collisionSpheres) {
+                // Closest point of the path to the center
+                f3vec c(s.x, s.y, s.z);
+                float dd = dot(d, d), t = dd > 0 ? std::min(std::max(dot(c - a, d) / dd, 0.f), 1.f) : 0.f;
+                in = in || (a + d * t - c).length() < s.w - slop;
+            }
+        } else if (m_collisionObj == COLLIDE_BOXES) {
+            for (size_t b = 1; b < m_collisionBoxes.size(); b++) {
+                // Clip the path to the box shrunk by the slop
+                f3vec lo = m_collisionBoxes[b].centroid() - m_collisionBoxes[b].extent() * 0.5f + f3vec(slop, slop, slop);
+                f3vec hi = m_collisionBoxes[b].centroid() + m_collisionBoxes[b].extent() * 0.5f - f3vec(slop, slop, slop);
+                float tEnter = 0, tExit = 1;
+                for (int k = 0; k < 3 && tEnter <= tExit; k++) {
+                    if (d[k] == 0) {
+                        if (a[k] < lo[k] || a[k] > hi[k]) tEnter = 2;
+                    } else {
+                        float t0 = (lo[k] - a[k]) / d[k], t1 = (hi[k] - a[k]) / d[k];
+                        tEnter = std::max(tEnter, std::min(t0, t1));
+                        tExit = std::min(tExit, std::max(t0, t1));
+                    }
+                }
+                in = in || tEnter <= tExit;
+            }
+        } else if (m_collisionObj == COLLIDE_INSIDE_BOXES && !m_collisionBoxes.empty()) {
+            // Nothing gets out of the inside box except by ending the step outside it
+            f3vec lo = m_collisionBoxes[0].centroid() - m_collisionBoxes[0].extent() * 0.5f;
+            f3vec hi = m_collisionBoxes[0].centroid() + m_collisionBoxes[0].extent() * 0.5f;
+            for (int k = 0; k < 3; k++) in = in || m_pos[i][k] < lo[k] - slop || m_pos[i][k] > hi[k] + slop;
+        }
+        if (in) count++;
     }
-    GL_ASSERT();
+    return m_pos.empty() ? 0.f : (float)count / m_pos.size();
+}
+
+void Cloth::Display(DrawMode drawMode)
+{
+    SyncState(false);
+    m_renderer.Draw(m_pos, drawMode);
 
     // Draw collision objects
     glLineWidth(1.5f);
@@ -361,26 +483,10 @@ void Cloth::Display(DrawMode drawMode)
     GL_ASSERT();
 }
 
-void Cloth::ReadTexture(const char* texName)
-{
-    uc3Image texIm(texName);
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glGenTextures(1, &m_texID);
-    glBindTexture(GL_TEXTURE_2D, m_texID);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 128.0f);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, texIm.w(), texIm.h(), GL_RGB, GL_UNSIGNED_BYTE, texIm.pp());
-
-    GL_ASSERT();
-}
-
 void Cloth::WriteTriModel(const char* FileName)
 {
     printf("Writing to %s (%d triangles). . .\n", FileName, m_numTris);
+    SyncState(false);
 
     FILE* fp = fopen(FileName, "w");
     if (fp == NULL) {
@@ -2,21 +2,32 @@
 
 #pragma once
 
-#include "Constraint.h"
+#include "ClothRenderer.h"
+#include "ClothSolver.h"
 #include "Math/AABB.h"
+#include "Transport.h"
 
+#include <memory>
+#include <random>
 #include <vector>
 
 enum ClothStyle { TABLECLOTH, CURTAIN, SLIDING_CURTAIN, PLEATED_CURTAIN, NUM_CLOTH_STYLES };
-enum DrawMode { DRAW_POINTS, DRAW_LINES, DRAW_TRIS, NUM_DRAW_MODES };
 enum CollisionObjects { COLLIDE_SPHERES, COLLIDE_BOXES, COLLIDE_INSIDE_BOXES, NUM_COLLISION_OBJECTS };
 
+class ClothLod;
+class DistCloth;
+
+// Building blocks shared by Cloth and the distributed cloth workers
+void AddGridConstraints(ClothConstraints& cons, int nx, int ny, float dx, float dy, int stiffening); // Rods within an nx x ny grid; Shuffle() them after
+unsigned ClothSolverFeatures(const ClothConstraints& cons, CollisionObjects collObj);                // Feature mask for MakeClothSolver()
+
 class Cloth {
 public:
     Cloth();
     Cloth(int nx, int ny, float dx, float dy,               // Number of grid points in x,y, and Spacing between grid points
           const f3vec& clothCenter,                         // Cloth center
-          float timestep, float damping, ClothStyle style); // Timestep, damping factor, and style of cloth
+          float timestep, float damping, ClothStyle style,  // Timestep, damping factor, and style of cloth
+          unsigned seed = 0);                               // Seeds the constraint order; give cloths on different threads their own
     ~Cloth();                                               // Destroy
     void TimeStep();                                        // Update cloth
     void Reset(ClothStyle clothStyle);                      // Move cloth to original position
@@ -25,21 +36,43 @@ public:
     void SetCollideObjectType(CollisionObjects collObj);    // What kind of objects to collide against
     void SetConstraintIters(int iters);                     // Set m_constraintItersPerTimeStep
     void SetStiffening(int stif, ClothStyle clothStyle);    // Set stiffening constraint span width
+    void SetParallel(bool parallel);                        // Use all cores for one cloth, or only the calling thread
+    void SetSpheres(const std::vector<f4vec>& spheres);     // Replace the default collision spheres
+    void SetBoxes(const std::vector<Aabb>& boxes);          // Replace the default collision boxes; box 0 is the inside box
+    void SetContinuousCollision(bool sweep);                // Also collide along each particle's and collider's path during a step
     void WriteTriModel(const char* filename);               // Write current cloth mesh to geometry file
     void GrabParticles(const f3vec& nPt);                   // Grab particles on projective mouse click line
     void UngrabParticles();                                 // Ungrab particles on mouse-up
     void MoveGrabbedParticles(const f3vec& delta);          // Interact with cloth by moving clicked-on particles
+    void SetDistributed(int numWorkers, TransportKind kind, const char* exeName); // Simulate in worker processes from now on; restarts the cloth
+    void SetPrecision(SolverPrecision precision);           // Float, double, or float storage with double math; keeps the current state
+    void SetLod(int stride);                                // Simulate every stride-th particle, refining near contacts; 1 simulates them all
+
+    // Read-only access to the cloth state, e.g. for streaming it to viewers. Positions are fetched from the workers on demand.
+    int GetNX() const { return m_nx; }
+    int GetNY() const { return m_ny; }
+    const std::vector<f3vec>& GetPositions()
+    {
+        SyncState(false);
+        return m_pos;
+    }
+    const std::vector<i3vec>& GetTriInds() const { return m_triInds; }
+    const std::vector<f2vec>& GetTexCoords() const { return m_texCoords; }
+    const std::vector<Aabb>& GetBoxes() const { return m_collisionBoxes; }
+    void MeasureStretch(float& meanErr, float& maxErr); // Relative rod length error over the grid
+    float MeanSpeed();                                  // Average particle speed
+    float MeasurePenetration();                         // Fraction of particles inside a collider or that passed through one on the last step
 
 private:
-    void VerletIntegration();
-    void SatisfyConstraints();
-    void AccumulateForces();
     void CreateSpheres();
-    void CollisionWithSpheres();
     void CreateBoxes();
-    void CollisionWithBoxes();
-
-    void ReadTexture(const char*);
+    void RebuildSolver();
+    void InitWorkers(); // Send m_dist's workers the current state and constraints
+    void AccumulateForces(); // Fill in m_forceAcc for this time step
+    void LodTimeStep();
+    bool RefineLod(); // Refine m_lod wherever it's needed now, between scheduled updates; returns true if the solver has to be rebuilt
+    void DistributedTimeStep();
+    void SyncState(bool oldPosToo); // Bring m_pos, and m_oldPos if asked, up to date with the simulation; call before reading them
 
     // Simulation data
     int m_nx;                                          // Grid points in x-dimension
@@ -48,23 +81,41 @@ private:
     f3vec m_initClothCenter;                           // Upper left hand corner of cloth
     std::vector<f3vec> m_pos;                          // Current particle positions
     std::vector<f3vec> m_oldPos;                       // Old positions
-    std::vector<f3vec> m_forceAcc;                     // Force accumulators
-    std::vector<Constraint*> m_constraints;            // Constraints
-    std::vector<PointConstraint*> m_grabConstraints;   // Constraints for particles that were grabbed for moving around
+    bool m_posStale = false;                           // The simulation has moved on since m_pos was last updated from the workers, solver, or LOD
+    bool m_oldPosStale = false;                        // Likewise for m_oldPos
+    ClothConstraints m_constraints;                    // Constraints
+    std::vector<GrabPin> m_grabs;                      // Particles that were grabbed for moving around
+    std::vector<f3vec> m_forceAcc;                     // Acceleration of each particle on top of gravity; empty if there's none
+    std::unique_ptr<ClothSolverBase> m_solver;         // Specialized for m_precision, the constraint kinds in use, and m_collisionObj
+    SolverPrecision m_precision = PRECISION_FLOAT;     // Solver precision
     f3vec m_gravity = {0, -40, 0};                     // Gravity
     float m_damping;                                   // Damping constant to improve stability
     float m_timeStep;                                  // Time step
+    unsigned m_seed;                                   // Seeds m_rng on each Reset()
+    std::mt19937 m_rng;                                // Shuffles the constraints; never shared with another cloth
     int m_constraintItersPerTimeStep = 10;             // Iterating constraint satisfaction improves quality a lot
     int m_stiffening = 1;                              // Add stiffening constraints that span this many particles
+    bool m_parallel = true;                            // Use std::execution::par_unseq for the per-particle and per-constraint loops
     CollisionObjects m_collisionObj = COLLIDE_SPHERES; // What kind of objects to collide against
     std::vector<f4vec> m_collisionSpheres;             // List of spheres to collide against
     std::vector<Aabb> m_collisionBoxes;                // List of boxes to collide against
+    std::vector<f4vec> m_prevSpheres;                  // Spheres as of the last time step, for continuous collision
+    std::vector<Aabb> m_prevBoxes;                     // Boxes as of the last time step
+    bool m_continuousCollision = true;                 // Sweep particles against moving colliders once per step
+    ClothStyle m_clothStyle = TABLECLOTH;              // Style from the last Reset()
+    std::unique_ptr<DistCloth> m_dist;                 // If set, workers simulate and this Cloth coordinates
+    std::unique_ptr<ClothLod> m_lod;                   // If set, the solver runs on a coarse grid and m_pos is reconstructed from it
+    ClothConstraints m_simConstraints;                 // m_constraints on the particles m_lod simulates
+    std::vector<f3vec> m_simPos, m_simOldPos;          // State of the particles m_lod simulates
+    std::vector<GrabPin> m_simGrabs;                   // m_grabs on the particles m_lod simulates
+    std::vector<f3vec> m_simForces;                    // m_forceAcc on the particles m_lod simulates
+    int m_lodUpdateInterval = 8;                       // Time steps between picking what to refine
+    int m_lodStepCount = 0;                            // Time steps since that
 
     // Rendering data
     int m_numTris;                  // Number of triangles for rendering
     std::vector<i3vec> m_triInds;   // Triangle indices for rendering and saving
     std::vector<f2vec> m_texCoords; // Texture coordinates per vertex for rendering
-    std::vector<f3vec> m_normals;   // Normals per vertex for rendering
     float m_texRepeats = 3.f;       // Times the texture image repeats across the cloth
-    unsigned int m_texID;           // OpenGL texture ID
+    ClothRenderer m_renderer;       // Owns the OpenGL buffers and texture; created on first Display() so the cloth can run headless
 };
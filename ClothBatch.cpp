@@ -0,0 +1,196 @@
+// ---------------------------------------------------
+// Cloth batch - Runs every simulation described by a set of scene files, several at once, and reports speed and quality of each
+// ---------------------------------------------------
+
+#include "Cloth.h"
+#include "Scene.h"
+#include "Util/Timer.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct BatchJob {
+    Scene scene;
+    size_t estBytes; // Rough memory footprint while running
+    bool taken;
+};
+
+// Settings
+int numThreads = (int)std::thread::hardware_concurrency(); // Simultaneous runs; each run uses one thread
+size_t memBudget = 0;                                      // Max bytes of all running cloths together; 0 means no limit
+bool pinThreads = true;                                    // Pin each runner thread to its own core
+const char* outName = "batch_results.csv";
+
+// Scheduler state
+std::vector<BatchJob> jobs;
+std::mutex jobMutex;
+std::condition_variable jobDone;
+size_t memInUse = 0;
+int numTaken = 0, numRunning = 0, numFinished = 0;
+FILE* outFile;
+
+// The particle arrays, the renderer's copies of the topology, and the rods dominate; the solver keeps its own copy of both in its own precision
+size_t estimateBytes(const Scene& scene)
+{
+    size_t n = (size_t)scene.nParticlesXY * scene.nParticlesXY;
+    size_t rodsPerParticle = scene.stiffening > 1 ? 8 : 4;
+    size_t solverScalar = scene.precision == PRECISION_FLOAT ? sizeof(float) : sizeof(double);
+    return n * (3 * sizeof(f3vec) + 2 * sizeof(f2vec) + 4 * sizeof(i3vec) + 6 * solverScalar) +
+           n * rodsPerParticle * (sizeof(RodDesc) + 2 * sizeof(int) + solverScalar);
+}
+
+void pinThisThread(int core)
+{
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % 64));
+#else
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+// Pick the next job that fits in the memory budget, or -1 if none does yet
+int takeJob()
+{
+    int oversized = -1;
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (jobs[j].taken) continue;
+        if (memBudget == 0 || memInUse + jobs[j].estBytes <= memBudget) return (int)j;
+        if (oversized < 0 && jobs[j].estBytes > memBudget) oversized = (int)j;
+    }
+
+    // A job bigger than the whole budget can only run by itself
+    if (oversized >= 0 && numRunning == 0) {
+        std::cerr << "WARNING: " << jobs[oversized].scene.name << " needs more than the memory budget; running it alone\n";
+        return oversized;
+    }
+
+    return -1;
+}
+
+void runJob(const Scene& scene, int jobIndex)
+{
+    // Concurrency comes from running many cloths at once, so each one stays on its own thread.
+    // Seeding from the job index keeps each run's rod order the same no matter which thread runs it or when.
+    Cloth* cloth = CreateCloth(scene, (unsigned)jobIndex);
+    cloth->SetParallel(false);
+
+    // Penetration has to be checked after every step, since a particle that tunnels is only caught on the step it does.
+    // That brings the whole state up to date each step, reconstructing it under level of detail, so only scenes that ask for it pay for it.
+    Timer timer;
+    double seconds = 0;
+    float penetration = 0;
+    for (int i = 0; i < scene.steps; i++) {
+        timer.Reset();
+        cloth->TimeStep();
+        seconds += timer.Reset();
+        if (scene.measurePenetration) penetration = std::max(penetration, cloth->MeasurePenetration());
+    }
+
+    float meanStretch, maxStretch;
+    cloth->MeasureStretch(meanStretch, maxStretch);
+    float meanSpeed = cloth->MeanSpeed();
+    delete cloth;
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    fprintf(outFile, "%s,%d,%g,%g,%d,%d,%d,%d,%d,%d,%d,%d,%g,%g,%g,%g,%g,", scene.name.c_str(), scene.nParticlesXY, scene.dt, scene.damping,
+            scene.constraintIters, scene.stiffening, scene.clothStyle, scene.collisionObjects, scene.precision, scene.sweptCollision, scene.lodStride,
+            scene.steps, seconds, seconds > 0 ? scene.steps / seconds : 0, meanStretch, maxStretch, meanSpeed);
+    if (scene.measurePenetration) fprintf(outFile, "%g", penetration); // Left empty if it wasn't measured
+    fprintf(outFile, "\n");
+    fflush(outFile); // Keep what we have if an overnight run gets killed
+    numFinished++;
+    std::cerr << numFinished << '/' << jobs.size() << ' ' << scene.name << ": " << scene.steps / seconds << " steps/sec, stretch " << meanStretch;
+    if (scene.measurePenetration) std::cerr << ", penetration " << penetration;
+    std::cerr << '\n';
+}
+
+// Runs jobs until there are none left; core is where to pin this thread, or -1
+void runnerThread(int core)
+{
+    // Pin before taking a job, so no part of a run, including its allocations, happens on some other core
+    if (core >= 0) pinThisThread(core);
+
+    while (true) {
+        int j = -1;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobDone.wait(lock, [&] { return numTaken == (int)jobs.size() || (j = takeJob()) >= 0; });
+            if (j < 0) break;
+            jobs[j].taken = true;
+            numTaken++;
+            memInUse += jobs[j].estBytes;
+            numRunning++;
+        }
+
+        runJob(jobs[j].scene, j);
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            memInUse -= jobs[j].estBytes;
+            numRunning--;
+        }
+        jobDone.notify_all();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+            numThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-memMB") && i + 1 < argc)
+            memBudget = (size_t)atoll(argv[++i]) << 20;
+        else if (!strcmp(argv[i], "-nopin"))
+            pinThreads = false;
+        else if (!strcmp(argv[i], "-out") && i + 1 < argc)
+            outName = argv[++i];
+        else {
+            std::vector<Scene> scenes;
+            if (!ReadScenes(argv[i], scenes)) exit(1);
+            for (auto& s : scenes) jobs.push_back({s, estimateBytes(s), false});
+        }
+    }
+
+    if (jobs.empty()) {
+        printf("Usage: %s [-threads N] [-memMB M] [-nopin] [-out results.csv] scene.txt ...\n", argv[0]);
+        exit(1);
+    }
+    numThreads = std::max(1, std::min(numThreads, (int)jobs.size()));
+
+    outFile = fopen(outName, "w");
+    if (outFile == NULL) {
+        printf("ERROR: unable to open [%s]!\n", outName);
+        exit(1);
+    }
+    fprintf(outFile, "name,nParticlesXY,dt,damping,constraintIters,stiffening,clothStyle,collisionObjects,precision,sweptCollision,lodStride,steps,"
+                     "seconds,stepsPerSec,meanStretch,maxStretch,meanSpeed,penetration\n");
+
+    std::cerr << "Running " << jobs.size() << " simulations on " << numThreads << " threads\n";
+    Timer totalTimer;
+    totalTimer.Reset();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) threads.emplace_back(runnerThread, pinThreads ? (int)(t % std::max(1u, std::thread::hardware_concurrency())) : -1);
+    for (auto& t : threads) t.join();
+
+    fclose(outFile);
+    std::cerr << "Finished in " << totalTimer.Reset() << " seconds; results are in " << outName << '\n';
+
+    return 0;
+}
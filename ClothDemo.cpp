@@ -3,7 +3,10 @@
 // ---------------------------------------------------
 
 #include "Cloth.h"
+#include "ClothStream.h"
+#include "DistCloth.h"
 #include "Math/Vector.h"
+#include "Scene.h"
 #include "Util/Assert.h"
 #include "Util/Timer.h"
 
@@ -13,16 +16,23 @@
 // This needs to come after GLEW
 #include "GL/freeglut.h"
 
+#include <csignal>
+#include <cstring>
+
 // User Interface Globals
 bool paused = false, fullScreen = false;
-int WW = 1024, WH = 1024, constraintIters = 50; // If it runs slow reduce constraintIters first.
-int stiffening = 1;                             // If > 1, sdd stiffening constraints that span this many particles
-int nParticlesXY = 110;                         // Num particles in each dimension
-f3vec grabPtWorld, grabPtWin;                   // The point being dragged around by a mouse click and drag
+int WW = 1024, WH = 1024;
+Scene scene;                                 // Cloth size, solver parameters, and colliders; see Scene.h for defaults
+int numWorkers = 0;                          // If > 0, simulate in this many worker processes
+TransportKind transportKind = TRANSPORT_SHM; // How the worker processes talk
+int streamPort = 0;                          // If > 0, stream the cloth to remote viewers on this port
+bool headless = false;                       // Simulate without a window; only useful with streamPort
+int headlessSteps = 0;                       // If > 0, stop the headless simulation after this many steps
+volatile std::sig_atomic_t stopRequested;    // Set by SIGINT or SIGTERM to end the headless simulation
+f3vec grabPtWorld, grabPtWin;                // The point being dragged around by a mouse click and drag
 DrawMode drawMode = DRAW_TRIS;
-ClothStyle clothStyle = TABLECLOTH;
-CollisionObjects collisionObjects = COLLIDE_SPHERES;
 Cloth* pCloth;
+ClothStreamServer* pStreamServer;
 Timer FrameRateTimer;
 
 // Given x,y,z window location compute 3D point clicked on; z should be like 0.9999
@@ -91,7 +101,10 @@ void userDisplayFunc0()
 void userIdleFunc0()
 {
     // Update cloth
-    if (!paused) { pCloth->TimeStep(); }
+    if (!paused) {
+        pCloth->TimeStep();
+        if (pStreamServer && pStreamServer->WantsFrame()) pStreamServer->Publish(pCloth->GetPositions());
+    }
     glutPostRedisplay();
 }
 
@@ -152,34 +165,34 @@ void userKeyboardFunc0(unsigned char Key, int x, int y)
         }
         break;
     case '-':
-        stiffening--;
-        if (stiffening < 1) stiffening = nParticlesXY - 1;
-        std::cerr << "stiffening: " << stiffening << '\n';
-        pCloth->SetStiffening(stiffening, clothStyle);
+        scene.stiffening--;
+        if (scene.stiffening < 1) scene.stiffening = scene.nParticlesXY - 1;
+        std::cerr << "stiffening: " << scene.stiffening << '\n';
+        pCloth->SetStiffening(scene.stiffening, scene.clothStyle);
         break;
     case '=':
-        stiffening++;
-        if (stiffening >= nParticlesXY) stiffening = 1;
-        std::cerr << "stiffening: " << stiffening << '\n';
-        pCloth->SetStiffening(stiffening, clothStyle);
+        scene.stiffening++;
+        if (scene.stiffening >= scene.nParticlesXY) scene.stiffening = 1;
+        std::cerr << "stiffening: " << scene.stiffening << '\n';
+        pCloth->SetStiffening(scene.stiffening, scene.clothStyle);
         break;
     case '+':
-        constraintIters++;
-        std::cerr << "constraintIters: " << constraintIters << '\n';
-        pCloth->SetConstraintIters(constraintIters);
+        scene.constraintIters++;
+        std::cerr << "constraintIters: " << scene.constraintIters << '\n';
+        pCloth->SetConstraintIters(scene.constraintIters);
         break;
     case '_':
-        constraintIters = max(constraintIters - 1, 0);
-        std::cerr << "constraintIters: " << constraintIters << '\n';
-        pCloth->SetConstraintIters(constraintIters);
+        scene.constraintIters = max(scene.constraintIters - 1, 0);
+        std::cerr << "constraintIters: " << scene.constraintIters << '\n';
+        pCloth->SetConstraintIters(scene.constraintIters);
         break;
     case 'c':
-        clothStyle = static_cast<ClothStyle>((clothStyle + 1) % NUM_CLOTH_STYLES);
-        std::cerr << "clothStyle: " << clothStyle << '\n';
-        pCloth->Reset(clothStyle);
+        scene.clothStyle = static_cast<ClothStyle>((scene.clothStyle + 1) % NUM_CLOTH_STYLES);
+        std::cerr << "clothStyle: " << scene.clothStyle << '\n';
+        pCloth->Reset(scene.clothStyle);
         break;
     case 'r':
-        if (pCloth) pCloth->Reset(clothStyle);
+        if (pCloth) pCloth->Reset(scene.clothStyle);
         break;
     case 'w':
         drawMode = static_cast<DrawMode>((drawMode + 1) % NUM_DRAW_MODES);
@@ -187,12 +200,31 @@ void userKeyboardFunc0(unsigned char Key, int x, int y)
         break;
     case 's': pCloth->WriteTriModel("tablecloth.tri"); break;
     case 'm':
-        collisionObjects = static_cast<CollisionObjects>((collisionObjects + 1) % NUM_COLLISION_OBJECTS);
-        std::cerr << "collisionObjects: " << collisionObjects << '\n';
-        pCloth->SetCollideObjectType(collisionObjects);
+        scene.collisionObjects = static_cast<CollisionObjects>((scene.collisionObjects + 1) % NUM_COLLISION_OBJECTS);
+        std::cerr << "collisionObjects: " << scene.collisionObjects << '\n';
+        pCloth->SetCollideObjectType(scene.collisionObjects);
+        break;
+    case 'p':
+        scene.precision = static_cast<SolverPrecision>((scene.precision + 1) % NUM_SOLVER_PRECISIONS);
+        std::cerr << "precision: " << scene.precision << '\n';
+        pCloth->SetPrecision(scene.precision);
+        break;
+    case 'x':
+        scene.sweptCollision = !scene.sweptCollision;
+        std::cerr << "sweptCollision: " << scene.sweptCollision << '\n';
+        pCloth->SetContinuousCollision(scene.sweptCollision != 0);
+        break;
+    case 'l':
+        scene.lodStride = scene.lodStride >= 8 ? 1 : scene.lodStride * 2;
+        std::cerr << "lodStride: " << scene.lodStride << '\n';
+        pCloth->SetLod(scene.lodStride);
         break;
     case 'q':
-    case '\033': /* ESC key: quit */ exit(0); break;
+    case '\033': /* ESC key: quit */
+        delete pStreamServer;
+        delete pCloth; // Lets worker processes exit
+        exit(0);
+        break;
     };
 }
 
@@ -219,8 +251,80 @@ void userSpecialKeyFunc0(int Key, int x, int y)
     }
 }
 
+// Create cloth with the scene's initial parameters
+void createCloth(const char* exeName)
+{
+    pCloth = CreateCloth(scene);
+    if (numWorkers > 0) pCloth->SetDistributed(numWorkers, transportKind, exeName);
+
+    if (streamPort > 0) {
+        StreamTopology topo;
+        topo.nx = pCloth->GetNX();
+        topo.ny = pCloth->GetNY();
+        topo.triInds = pCloth->GetTriInds();
+        topo.texCoords = pCloth->GetTexCoords();
+        pStreamServer = new ClothStreamServer(streamPort, topo);
+    }
+}
+
+void requestStop(int) { stopRequested = 1; }
+
+// Simulate and stream on a machine with no display, until headlessSteps or Ctrl-C
+void runHeadless()
+{
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    int stepCount = 0;
+    for (int step = 0; !stopRequested && (headlessSteps <= 0 || step < headlessSteps); step++) {
+        if (stepCount++ == 600) {
+            double time = stepCount / FrameRateTimer.Reset();
+            std::cerr << "Avg. steps per second: " << time << '\n';
+            stepCount = 0;
+        }
+
+        // Fetching the positions can mean gathering them from the workers or reconstructing them, so only do it for a waiting viewer
+        pCloth->TimeStep();
+        if (pStreamServer && pStreamServer->WantsFrame()) pStreamServer->Publish(pCloth->GetPositions());
+    }
+
+    // Disconnects the viewers and tells the workers to quit
+    delete pStreamServer;
+    delete pCloth;
+    pStreamServer = nullptr;
+    pCloth = nullptr;
+}
+
 int main(int argc, char** argv)
 {
+    // Worker processes for distributed simulation are headless
+    if (argc > 1 && !strcmp(argv[1], "-worker")) return RunClothWorker(argc, argv);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-dist") && i + 1 < argc)
+            numWorkers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-tcp"))
+            transportKind = TRANSPORT_TCP;
+        else if (!strcmp(argv[i], "-serve") && i + 1 < argc)
+            streamPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "-steps") && i + 1 < argc)
+            headlessSteps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-scene") && i + 1 < argc) {
+            // Only the first combination of a sweep is used interactively; ClothBatch runs them all
+            std::vector<Scene> scenes;
+            if (!ReadScenes(argv[++i], scenes)) exit(1);
+            scene = scenes[0];
+        }
+    }
+
+    if (headless) {
+        createCloth(argv[0]);
+        runHeadless();
+        return 0;
+    }
+
     glutInit(&argc, argv);
 
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH | GLUT_RGBA);
@@ -228,6 +332,9 @@ int main(int argc, char** argv)
     glutInitWindowPosition(50, 50);
     glutCreateWindow("Cloth");
 
+    GLenum glewErr = glewInit(); // Needed for the buffer objects the cloth renderer uses
+    ASSERT_R(glewErr == GLEW_OK);
+
     glShadeModel(GL_SMOOTH);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LINE_SMOOTH);
@@ -245,15 +352,7 @@ int main(int argc, char** argv)
     glutSpecialFunc(userSpecialKeyFunc0);
     glutReshapeFunc(userReshapeFunc0);
 
-    // Create cloth with these initial parameters
-    float clothWid = 60.f;
-    f3vec startPos(0, clothWid / 2, 0);
-    float dt = 0.03f;
-    float damping = 0.95f;
-    float partStep = clothWid / nParticlesXY;
-    pCloth = new Cloth(nParticlesXY, nParticlesXY, partStep, partStep, startPos, dt, damping, clothStyle);
-    pCloth->SetCollideObjectType(collisionObjects);
-    pCloth->SetConstraintIters(constraintIters);
+    createCloth(argv[0]);
 
     GLfloat lightPos[] = {2.0, 30.0, 5.0, 1.0};
 
@@ -0,0 +1,334 @@
+// ClothLod.cpp
+
+#include "ClothLod.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Coarse rows or columns every stride particles, ending exactly on the last one
+static void CoarseLines(int n, int stride, std::vector<int>& lines, std::vector<int>& lineCell)
+{
+    lines.clear();
+    for (int i = 0; i < n - 1; i += stride) lines.push_back(i);
+    if (lines.size() > 1 && n - 1 - lines.back() < stride / 2) lines.pop_back(); // Merge a sliver into the cell before it
+    lines.push_back(n - 1);
+
+    lineCell.resize(n);
+    int numCells = (int)lines.size() - 1;
+    for (int c = 0; c < numCells; c++)
+        for (int i = lines[c]; i < lines[c + 1]; i++) lineCell[i] = c;
+    lineCell[n - 1] = numCells - 1;
+}
+
+// Weights of the four control points at knots k[0..3] of a Catmull-Rom spline at x between k[1] and k[2].
+// The tangents are central differences over the knots, so the last coarse cell being narrower doesn't put a kink in a flat cloth.
+static void CatmullRomWeights(float x, const float k[4], float w[4])
+{
+    float h = k[2] - k[1], t = (x - k[1]) / h, t2 = t * t, t3 = t2 * t;
+    float h00 = 2 * t3 - 3 * t2 + 1, h10 = t3 - 2 * t2 + t, h01 = -2 * t3 + 3 * t2, h11 = t3 - t2;
+    float m1 = h / (k[2] - k[0]), m2 = h / (k[3] - k[1]);
+    w[0] = -h10 * m1;
+    w[1] = h00 - h11 * m2;
+    w[2] = h01 + h10 * m1;
+    w[3] = h11 * m2;
+}
+
+// Full grid position of coarse line c, extrapolated past the ends like ClothLod::Coarse()
+static float Knot(const std::vector<int>& lines, int c)
+{
+    int last = (int)lines.size() - 1;
+    if (c < 0) return (float)(2 * lines[0] - lines[1]);
+    if (c > last) return (float)(2 * lines[last] - lines[last - 1]);
+    return (float)lines[c];
+}
+
+ClothLod::ClothLod(int nx, int ny, float dx, float dy, int stride) : m_nx(nx), m_ny(ny), m_dx(dx), m_dy(dy), m_stride(stride)
+{
+    CoarseLines(nx, stride, m_cols, m_colCell);
+    CoarseLines(ny, stride, m_rows, m_rowCell);
+    m_ncx = (int)m_cols.size() - 1;
+    m_ncy = (int)m_rows.size() - 1;
+    m_refined.assign((size_t)m_ncx * m_ncy, 0);
+    m_idle.assign((size_t)m_ncx * m_ncy, 0);
+    m_rowIndices.resize(ny);
+    std::iota(m_rowIndices.begin(), m_rowIndices.end(), 0);
+
+    // The spline weights only depend on where a particle is within its cell
+    m_colWeights.resize(4 * (size_t)nx);
+    m_rowWeights.resize(4 * (size_t)ny);
+    float k[4];
+    for (int i = 0; i < nx; i++) {
+        for (int a = 0; a < 4; a++) k[a] = Knot(m_cols, m_colCell[i] - 1 + a);
+        CatmullRomWeights((float)i, k, &m_colWeights[4 * i]);
+    }
+    for (int j = 0; j < ny; j++) {
+        for (int a = 0; a < 4; a++) k[a] = Knot(m_rows, m_rowCell[j] - 1 + a);
+        CatmullRomWeights((float)j, k, &m_rowWeights[4 * j]);
+    }
+}
+
+f3vec ClothLod::Coarse(const std::vector<f3vec>& pos, int cx, int cy) const
+{
+    if (cx < 0) return Coarse(pos, 0, cy) * 2.f - Coarse(pos, 1, cy);
+    if (cx > m_ncx) return Coarse(pos, m_ncx, cy) * 2.f - Coarse(pos, m_ncx - 1, cy);
+    if (cy < 0) return Coarse(pos, cx, 0) * 2.f - Coarse(pos, cx, 1);
+    if (cy > m_ncy) return Coarse(pos, cx, m_ncy) * 2.f - Coarse(pos, cx, m_ncy - 1);
+    return pos[m_cols[cx] + m_nx * m_rows[cy]];
+}
+
+void ClothLod::WantedCells(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj,
+                            const std::vector<f4vec>& spheres, const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs,
+                            const ClothConstraints& fineCons, std::vector<char>& want) const
+{
+    // Bending at each coarse particle, as the larger angle between the coarse rods on either side of it
+    auto turn = [](const f3vec& a, const f3vec& b) {
+        float len = a.length() * b.length();
+        return len > 0 ? acosf(std::min(std::max(dot(a, b) / len, -1.f), 1.f)) : 0.f;
+    };
+    std::vector<float> bend((size_t)(m_ncx + 1) * (m_ncy + 1), 0.f);
+    for (int cy = 1; cy < m_ncy; cy++) {
+        for (int cx = 1; cx < m_ncx; cx++) {
+            f3vec p = Coarse(pos, cx, cy);
+            float bx = turn(p - Coarse(pos, cx - 1, cy), Coarse(pos, cx + 1, cy) - p);
+            float by = turn(p - Coarse(pos, cx, cy - 1), Coarse(pos, cx, cy + 1) - p);
+            bend[cx + (m_ncx + 1) * cy] = std::max(bx, by);
+        }
+    }
+
+    // Cells already refined stay that way until they are well clear of what refined them, so they don't flicker
+    want.assign(m_refined.size(), 0);
+    for (int cy = 0; cy < m_ncy; cy++) {
+        for (int cx = 0; cx < m_ncx; cx++) {
+            bool was = m_refined[cx + m_ncx * cy];
+            float margin = std::max((m_cols[cx + 1] - m_cols[cx]) * m_dx, (m_rows[cy + 1] - m_rows[cy]) * m_dy) * (was ? 2.f : 1.f);
+            float curvature = m_curvature * (was ? 0.75f : 1.f);
+
+            // Also look as far ahead as the cell can travel before the next update, so it is refined before it gets there
+            f3vec lo = Coarse(pos, cx, cy), hi = lo;
+            float travel = 0;
+            for (int k = 0; k < 4; k++) {
+                f3vec c = Coarse(pos, cx + (k & 1), cy + (k >> 1));
+                travel = std::max(travel, (c - Coarse(oldPos, cx + (k & 1), cy + (k >> 1))).length() * stepsAhead);
+                lo = f3vec(std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z));
+                hi = f3vec(std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z));
+                if (bend[cx + (k & 1) + (m_ncx + 1) * (cy + (k >> 1))] > curvature) want[cx + m_ncx * cy] = 1;
+            }
+            margin += travel;
+
+            // Coarse rods would snap a wrinkled or bunched cell straight, so a refined cell also stays that way until its corners are nearly at rest
+            if (was) {
+                int i0 = m_cols[cx], i1 = m_cols[cx + 1], j0 = m_rows[cy], j1 = m_rows[cy + 1];
+                int corners[4] = {i0 + m_nx * j0, i1 + m_nx * j0, i0 + m_nx * j1, i1 + m_nx * j1};
+                for (int a = 0; a < 4; a++) {
+                    for (int b = a + 1; b < 4; b++) {
+                        float rx = (corners[b] % m_nx - corners[a] % m_nx) * m_dx, ry = (corners[b] / m_nx - corners[a] / m_nx) * m_dy;
+                        float rest = sqrtf(rx * rx + ry * ry);
+                        if (fabsf((pos[corners[b]] - pos[corners[a]]).length() - rest) > m_coarsenStrain * rest) want[cx + m_ncx * cy] = 1;
+                    }
+                }
+            }
+
+            if (collObj == COLLIDE_SPHERES) {
+                for (const f4vec& s : spheres) {
+                    f3vec c(s.x, s.y, s.z), nearest;
+                    for (int k = 0; k < 3; k++) nearest[k] = std::min(std::max(c[k], lo[k]), hi[k]);
+                    if ((nearest - c).length() < s.w + margin) want[cx + m_ncx * cy] = 1;
+                }
+            } else {
+                // The cell is near an outside box if its bounds overlap the grown box, and near the inside box if they aren't well inside it
+                bool inside = collObj == COLLIDE_INSIDE_BOXES;
+                for (size_t b = inside ? 0 : 1; b < (inside ? std::min((size_t)1, boxes.size()) : boxes.size()); b++) {
+                    f3vec bc = boxes[b].centroid(), bh = boxes[b].extent() * 0.5f;
+                    bool near = false;
+                    for (int k = 0; k < 3; k++) {
+                        if (inside)
+                            near = near || lo[k] < bc[k] - bh[k] + margin || hi[k] > bc[k] + bh[k] - margin;
+                        else
+                            near = (k == 0 || near) && lo[k] < bc[k] + bh[k] + margin && hi[k] > bc[k] - bh[k] - margin;
+                    }
+                    if (near) want[cx + m_ncx * cy] = 1;
+                }
+            }
+        }
+    }
+
+    // Grabbed and pinned particles always have to be simulated
+    auto refineAt = [&](int index) { want[m_colCell[index % m_nx] + m_ncx * m_rowCell[index / m_nx]] = 1; };
+    for (const GrabPin& g : grabs) refineAt(g.index);
+    for (const PinDesc& p : fineCons.pins) refineAt(p.index);
+    for (const PinDesc& p : fineCons.sliders) refineAt(p.index);
+}
+
+bool ClothLod::UpdateRefinement(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj,
+                                const std::vector<f4vec>& spheres, const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs,
+                                const ClothConstraints& fineCons)
+{
+    std::vector<char> want;
+    WantedCells(pos, oldPos, stepsAhead, collObj, spheres, boxes, grabs, fineCons, want);
+
+    // Refine right away, but only go back to coarse after a cell hasn't been needed for a while, since every switch costs a little energy
+    bool changed = false;
+    for (size_t c = 0; c < want.size(); c++) {
+        m_idle[c] = want[c] ? 0 : m_idle[c] + 1;
+        char refined = want[c] || (m_refined[c] && m_idle[c] < m_coarsenDelay);
+        changed = changed || refined != m_refined[c];
+        m_refined[c] = refined;
+    }
+    return changed;
+}
+
+bool ClothLod::Refine(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj,
+                      const std::vector<f4vec>& spheres, const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs, const ClothConstraints& fineCons)
+{
+    std::vector<char> want;
+    WantedCells(pos, oldPos, stepsAhead, collObj, spheres, boxes, grabs, fineCons, want);
+
+    // Off the update schedule nothing is coarsened and m_idle is left alone, so the cells go back to coarse on the usual cadence
+    bool changed = false;
+    for (size_t c = 0; c < want.size(); c++) {
+        changed = changed || (want[c] && !m_refined[c]);
+        m_refined[c] = m_refined[c] || want[c];
+    }
+    return changed;
+}
+
+void ClothLod::AddRod(std::vector<RodDesc>& rods, int a, int b) const
+{
+    float rx = (b % m_nx - a % m_nx) * m_dx, ry = (b / m_nx - a / m_nx) * m_dy;
+    rods.push_back({m_fineToSim[a], m_fineToSim[b], sqrtf(rx * rx + ry * ry)});
+}
+
+void ClothLod::Build(const ClothConstraints& fineCons, int stiffening, const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos,
+                     ClothConstraints& simCons, std::vector<f3vec>& simPos, std::vector<f3vec>& simOldPos, std::mt19937& rng)
+{
+    // The coarse particles and every particle of a refined cell, including its edges, are simulated
+    std::vector<char> simulated((size_t)m_nx * m_ny, 0);
+    for (int cy = 0; cy <= m_ncy; cy++)
+        for (int cx = 0; cx <= m_ncx; cx++) simulated[m_cols[cx] + m_nx * m_rows[cy]] = 1;
+    for (int cy = 0; cy < m_ncy; cy++)
+        for (int cx = 0; cx < m_ncx; cx++)
+            if (Refined(cx, cy))
+                for (int j = m_rows[cy]; j <= m_rows[cy + 1]; j++)
+                    for (int i = m_cols[cx]; i <= m_cols[cx + 1]; i++) simulated[i + m_nx * j] = 1;
+
+    m_fineToSim.assign(simulated.size(), -1);
+    m_simToFine.clear();
+    for (size_t i = 0; i < simulated.size(); i++) {
+        if (!simulated[i]) continue;
+        m_fineToSim[i] = (int)m_simToFine.size();
+        m_simToFine.push_back((int)i);
+    }
+
+    // Each cell adds the rods along its top and left edges and inside it, plus its bottom and right edges if nothing else will.
+    // A refined cell next to an unrefined one adds its fine rods along their shared edge, and the unrefined one may add a coarse rod there, too.
+    simCons.Clear();
+    for (int cy = 0; cy < m_ncy; cy++) {
+        for (int cx = 0; cx < m_ncx; cx++) {
+            int i0 = m_cols[cx], i1 = m_cols[cx + 1], j0 = m_rows[cy], j1 = m_rows[cy + 1];
+            if (Refined(cx, cy)) {
+                for (int j = j0; j < j1; j++) {
+                    for (int i = i0; i < i1; i++) {
+                        int p1 = i + m_nx * j;           // Index point
+                        int p2 = i + 1 + m_nx * j;       // P1---p2
+                        int p3 = i + m_nx * (j + 1);     //  |    |
+                        int p4 = i + 1 + m_nx * (j + 1); // P3---p4
+
+                        AddRod(simCons.rods, p1, p2);
+                        AddRod(simCons.rods, p1, p3);
+                        AddRod(simCons.rods, p1, p4);
+                        AddRod(simCons.rods, p2, p3);
+                        if (i + 1 == i1 && !Refined(cx + 1, cy)) AddRod(simCons.rods, p2, p4);
+                        if (j + 1 == j1 && !Refined(cx, cy + 1)) AddRod(simCons.rods, p3, p4);
+                    }
+                }
+            } else {
+                int c00 = i0 + m_nx * j0, c10 = i1 + m_nx * j0, c01 = i0 + m_nx * j1, c11 = i1 + m_nx * j1;
+                AddRod(simCons.rods, c00, c10);
+                AddRod(simCons.rods, c00, c01);
+                AddRod(simCons.rods, c00, c11);
+                AddRod(simCons.rods, c10, c01);
+                if (cx == m_ncx - 1) AddRod(simCons.rods, c10, c11);
+                if (cy == m_ncy - 1) AddRod(simCons.rods, c01, c11);
+            }
+        }
+    }
+
+    // Stiffening rods between simulated particles carry over, which covers refined cells and, if stiffening is a multiple of the stride, the coarse grid.
+    // Otherwise the coarse grid gets its own, spanning the nearest whole number of cells, so switching levels doesn't suddenly stiffen or relax the cloth.
+    for (const RodDesc& r : fineCons.stiffRods)
+        if (m_fineToSim[r.a] >= 0 && m_fineToSim[r.b] >= 0) simCons.stiffRods.push_back({m_fineToSim[r.a], m_fineToSim[r.b], r.restLen});
+
+    const int ST = (stiffening + m_stride / 2) / m_stride;
+    if (ST > 1 && stiffening % m_stride)
+        for (int cy = 0; cy <= m_ncy; cy++) {
+            for (int cx = 0; cx <= m_ncx; cx++) {
+                int p1 = m_cols[cx] + m_nx * m_rows[cy];
+                if (cx + ST <= m_ncx) AddRod(simCons.stiffRods, p1, m_cols[cx + ST] + m_nx * m_rows[cy]);
+                if (cy + ST <= m_ncy) AddRod(simCons.stiffRods, p1, m_cols[cx] + m_nx * m_rows[cy + ST]);
+                if (cx + ST <= m_ncx && cy + ST <= m_ncy) {
+                    AddRod(simCons.stiffRods, p1, m_cols[cx + ST] + m_nx * m_rows[cy + ST]);
+                    AddRod(simCons.stiffRods, m_cols[cx + ST] + m_nx * m_rows[cy], m_cols[cx] + m_nx * m_rows[cy + ST]);
+                }
+            }
+        }
+
+    for (const PinDesc& p : fineCons.pins) simCons.pins.push_back({m_fineToSim[p.index], p.pos, p.axes});
+    for (const PinDesc& p : fineCons.sliders) simCons.sliders.push_back({m_fineToSim[p.index], p.pos, p.axes});
+    simCons.Shuffle(rng);
+
+    simPos.resize(m_simToFine.size());
+    simOldPos.resize(m_simToFine.size());
+    for (size_t s = 0; s < m_simToFine.size(); s++) {
+        simPos[s] = pos[m_simToFine[s]];
+        simOldPos[s] = oldPos[m_simToFine[s]];
+    }
+}
+
+void ClothLod::InterpolateRow(const std::vector<f3vec>& coarse, int j, std::vector<f3vec>& pos) const
+{
+    int cy = m_rowCell[j], j0 = m_rows[cy], j1 = m_rows[cy + 1], stride = m_ncx + 3;
+    float v = (float)(j - j0) / (j1 - j0);
+    const float* wv = &m_rowWeights[4 * j];
+
+    // The Catmull-Rom surface is separable, so blend the coarse rows around this one down to a single row first
+    std::vector<f3vec> blended(stride);
+    const f3vec* c = &coarse[stride * cy]; // Coarse row above this cell, in the ring
+    for (int a = 0; a < stride; a++) blended[a] = c[a] * wv[0] + c[a + stride] * wv[1] + c[a + 2 * stride] * wv[2] + c[a + 3 * stride] * wv[3];
+
+    for (int i = 0; i < m_nx; i++) {
+        if (m_fineToSim[i + m_nx * j] >= 0) continue;
+
+        int cx = m_colCell[i], i0 = m_cols[cx], i1 = m_cols[cx + 1];
+        const float* wu = &m_colWeights[4 * i];
+        const f3vec* b = &blended[cx]; // Coarse column left of this cell, in the ring
+        f3vec p = b[0] * wu[0] + b[1] * wu[1] + b[2] * wu[2] + b[3] * wu[3];
+
+        // Where a refined neighbor simulates the shared edge in detail, blend the difference between it and the surface in from that edge.
+        // The surface passes through the corners, so this is a Coons patch of the edge differences and stays continuous with the neighbor.
+        if (Refined(cx - 1, cy)) p += (pos[i0 + m_nx * j] - b[1]) * (1 - (float)(i - i0) / (i1 - i0));
+        if (Refined(cx + 1, cy)) p += (pos[i1 + m_nx * j] - b[2]) * ((float)(i - i0) / (i1 - i0));
+        for (int edge = 0; edge < 2; edge++) {
+            if (!Refined(cx, cy - 1 + 2 * edge)) continue;
+            const f3vec* e = &coarse[cx + stride * (cy + 1 + edge)];
+            f3vec surface = e[0] * wu[0] + e[1] * wu[1] + e[2] * wu[2] + e[3] * wu[3];
+            p += (pos[i + m_nx * (edge ? j1 : j0)] - surface) * (edge ? v : 1 - v);
+        }
+
+        pos[i + m_nx * j] = p;
+    }
+}
+
+void ClothLod::Reconstruct(const std::vector<f3vec>& simPos, std::vector<f3vec>& pos, bool parallel) const
+{
+    for (size_t s = 0; s < m_simToFine.size(); s++) pos[m_simToFine[s]] = simPos[s];
+
+    // The coarse particles with a ring of extrapolated ones around them, so the spline needs no edge cases
+    std::vector<f3vec> coarse((size_t)(m_ncx + 3) * (m_ncy + 3));
+    for (int cy = -1; cy <= m_ncy + 1; cy++)
+        for (int cx = -1; cx <= m_ncx + 1; cx++) coarse[cx + 1 + (m_ncx + 3) * (cy + 1)] = Coarse(pos, cx, cy);
+
+    // Only reads simulated particles, so every row can be filled in independently
+    ForEach(parallel, m_rowIndices.begin(), m_rowIndices.end(), [&](int j) { InterpolateRow(coarse, j, pos); });
+}
@@ -0,0 +1,64 @@
+// ClothLod.h - Level of detail for a cloth: simulate a coarse grid and reconstruct the full resolution mesh from it
+// Every stride-th particle in each direction is always simulated. Cells of that coarse grid that are near a collider, hold a grab or pin,
+// or are sharply bent are refined, so every particle in them is simulated too. Everything else is filled in with a Catmull-Rom surface
+// through the coarse particles, blended into the detailed edges of refined neighbors so the full resolution mesh has no cracks.
+
+#pragma once
+
+#include "Cloth.h"
+
+#include <vector>
+
+class ClothLod {
+public:
+    ClothLod(int nx, int ny, float dx, float dy, int stride); // Size and rest spacing of the full resolution grid, and coarse grid spacing in particles
+    int Stride() const { return m_stride; }
+    size_t NumSimulated() const { return m_simToFine.size(); }
+
+    // Pick the cells to refine for the next stepsAhead time steps; returns true if they changed, so the solver has to be rebuilt.
+    // Each call counts toward coarsening the cells that aren't needed any more, so only call it once per update interval.
+    bool UpdateRefinement(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj,
+                          const std::vector<f4vec>& spheres, const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs,
+                          const ClothConstraints& fineCons);
+
+    // Refine whatever needs it right now, e.g. a new grab, without coarsening anything or advancing the schedule UpdateRefinement() keeps
+    bool Refine(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj, const std::vector<f4vec>& spheres,
+                const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs, const ClothConstraints& fineCons);
+
+    // Constraints over the simulated particles, with the pins of fineCons carried over, and the simulated particles' state taken from the full grid.
+    // rng shuffles the constraints.
+    void Build(const ClothConstraints& fineCons, int stiffening, const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, ClothConstraints& simCons,
+               std::vector<f3vec>& simPos, std::vector<f3vec>& simOldPos, std::mt19937& rng);
+
+    int SimIndex(int fine) const { return m_fineToSim[fine]; } // -1 if that particle isn't simulated
+    void Reconstruct(const std::vector<f3vec>& simPos, std::vector<f3vec>& pos, bool parallel) const; // Fill in the full grid from the simulated particles
+
+private:
+    // Cells the colliders, grabs, pins, and bends need refined over the next stepsAhead time steps
+    void WantedCells(const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos, int stepsAhead, CollisionObjects collObj,
+                     const std::vector<f4vec>& spheres, const std::vector<Aabb>& boxes, const std::vector<GrabPin>& grabs, const ClothConstraints& fineCons,
+                     std::vector<char>& want) const;
+    bool Refined(int cx, int cy) const { return cx >= 0 && cy >= 0 && cx < m_ncx && cy < m_ncy && m_refined[cx + m_ncx * cy]; }
+    f3vec Coarse(const std::vector<f3vec>& pos, int cx, int cy) const;    // Coarse particle; extrapolates past the edges
+    void InterpolateRow(const std::vector<f3vec>& coarse, int j, std::vector<f3vec>& pos) const; // Fill in row j; coarse has a ring around it
+    void AddRod(std::vector<RodDesc>& rods, int a, int b) const;          // Rod between two simulated full grid particles, at their rest distance
+
+    int m_nx, m_ny;                  // Full resolution grid
+    float m_dx, m_dy;                // Rest spacing
+    int m_stride;                    // Coarse grid spacing in particles
+    std::vector<int> m_cols;         // Full grid column of each coarse column; the last one is always nx - 1
+    std::vector<int> m_rows;         // Full grid row of each coarse row
+    std::vector<int> m_colCell;      // Coarse cell column containing each full grid column; the one to the right on a boundary
+    std::vector<int> m_rowCell;      // Coarse cell row containing each full grid row
+    std::vector<float> m_colWeights; // Four Catmull-Rom weights per full grid column, for the coarse columns around its cell
+    std::vector<float> m_rowWeights; // Four per full grid row
+    int m_ncx, m_ncy;                // Coarse cells in each direction
+    std::vector<char> m_refined;     // Per coarse cell
+    std::vector<int> m_idle;         // Updates since each coarse cell last needed refining
+    std::vector<int> m_rowIndices;   // 0 .. ny - 1, to reconstruct rows in parallel
+    std::vector<int> m_fineToSim;    // Index of each full grid particle among the simulated ones, or -1
+    std::vector<int> m_simToFine;    // Full grid index of each simulated particle
+    float m_curvature = 0.6f;        // Refine where the coarse grid turns by more than this many radians at a coarse particle
+    float m_coarsenStrain = 0.05f;   // Keep refining a cell until its corners are within this fraction of their rest distances
+    int m_coarsenDelay = 8;          // Updates a cell stays refined after it was last needed
+};
@@ -0,0 +1,59 @@
+// ClothLodCheck.cpp - Headless check of the ClothLod coarsening schedule; exits nonzero if any case fails
+
+#include "ClothLod.h"
+
+#include <cstdio>
+#include <vector>
+
+static int numFailed = 0;
+
+static void Check(bool ok, const char* what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) numFailed++;
+}
+
+// A flat 9 x 9 cloth at rest with stride 4 has 2 x 2 coarse cells, and nothing but a grab on particle 0 wants any of them refined.
+// Refine() calls between scheduled updates must not count toward coarsening, so the grabbed cell goes back to coarse on exactly
+// the m_coarsenDelay-th UpdateRefinement() after the grab is released.
+static void CoarsenSchedule()
+{
+    const int nx = 9, ny = 9, stride = 4, coarsenDelay = 8;
+    std::vector<f3vec> pos(nx * ny);
+    for (int j = 0; j < ny; j++)
+        for (int i = 0; i < nx; i++) pos[i + nx * j] = f3vec(i * 0.1f, j * 0.1f, 0);
+    std::vector<f4vec> spheres;
+    std::vector<Aabb> boxes;
+    std::vector<GrabPin> grabbed = {{0, pos[0]}}, none;
+    ClothConstraints cons;
+
+    ClothLod lod(nx, ny, 0.1f, 0.1f, stride);
+    Check(lod.Refine(pos, pos, 8, COLLIDE_SPHERES, spheres, boxes, grabbed, cons), "Refine() refines the grabbed cell right away");
+    Check(!lod.Refine(pos, pos, 8, COLLIDE_SPHERES, spheres, boxes, grabbed, cons), "Refine() again changes nothing");
+    Check(!lod.UpdateRefinement(pos, pos, 8, COLLIDE_SPHERES, spheres, boxes, grabbed, cons), "scheduled update keeps the grabbed cell");
+
+    // Grab released; off-schedule refinement must leave the cell and its idle count alone
+    bool refineChanged = false;
+    for (int k = 0; k < 20; k++) refineChanged = refineChanged || lod.Refine(pos, pos, 8, COLLIDE_SPHERES, spheres, boxes, none, cons);
+    Check(!refineChanged, "20 Refine() calls neither coarsen nor refine anything");
+
+    int coarsenedOn = 0;
+    for (int u = 1; u <= 2 * coarsenDelay && !coarsenedOn; u++)
+        if (lod.UpdateRefinement(pos, pos, 8, COLLIDE_SPHERES, spheres, boxes, none, cons)) coarsenedOn = u;
+    Check(coarsenedOn == coarsenDelay, "cell coarsens on exactly the 8th scheduled update after the grab");
+
+    // Only the 3 x 3 coarse particles are left to simulate
+    ClothConstraints simCons;
+    std::vector<f3vec> simPos, simOldPos;
+    std::mt19937 rng(1);
+    lod.Build(cons, 0, pos, pos, simCons, simPos, simOldPos, rng);
+    Check(lod.NumSimulated() == 9, "coarsened cloth simulates only the coarse particles");
+}
+
+int main(int argc, char** argv)
+{
+    CoarsenSchedule();
+
+    if (numFailed) printf("ERROR: %d level of detail checks failed\n", numFailed);
+    return numFailed ? 1 : 0;
+}
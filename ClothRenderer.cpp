@@ -0,0 +1,206 @@
+// ClothRenderer.cpp
+
+#include "ClothRenderer.h"
+
+#include "Image/tImage.h"
+
+// OpenGL
+#include "GL/glew.h"
+
+// This needs to come after GLEW
+#include "GL/freeglut.h"
+
+#include <cstddef>
+
+#define BUFFER_OFFSET(bytes) ((const void*)(size_t)(bytes))
+
+ClothRenderer::ClothRenderer(const char* texName) : m_texName(texName) {}
+
+ClothRenderer::~ClothRenderer()
+{
+    // There may be no GL context by the time the cloth is destroyed, so only release what we actually created
+    if (!m_glInited) return;
+
+    for (auto& f : m_fences)
+        if (f) glDeleteSync(f);
+    if (m_mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_streamVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    GLuint bufs[] = {m_streamVBO, m_uvVBO, m_indexVBO};
+    glDeleteBuffers(3, bufs);
+    glDeleteTextures(1, &m_texID);
+}
+
+void ClothRenderer::SetTopology(int nx, int ny, const std::vector<i3vec>& triInds, const std::vector<f2vec>& texCoords)
+{
+    m_nx = nx;
+    m_ny = ny;
+    m_triInds = triInds;
+    m_texCoords = texCoords;
+    m_staticDirty = true;
+}
+
+void ClothRenderer::InitGL()
+{
+    ReadTexture(m_texName);
+
+    glGenBuffers(1, &m_streamVBO);
+    glGenBuffers(1, &m_uvVBO);
+    glGenBuffers(1, &m_indexVBO);
+    m_persistent = GLEW_ARB_buffer_storage;
+    m_glInited = true;
+
+    GL_ASSERT();
+}
+
+void ClothRenderer::UploadStatic()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_uvVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_texCoords.size() * sizeof(f2vec), m_texCoords.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_triInds.size() * sizeof(i3vec), m_triInds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // (Re)allocate the streaming buffer if the grid got bigger. Immutable storage can't be resized, so make a new buffer.
+    size_t numVerts = (size_t)m_nx * m_ny;
+    if (numVerts > m_streamCapacity) {
+        for (auto& f : m_fences)
+            if (f) {
+                glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(f);
+                f = nullptr;
+            }
+        glDeleteBuffers(1, &m_streamVBO);
+        glGenBuffers(1, &m_streamVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_streamVBO);
+        m_streamCapacity = numVerts;
+
+        if (m_persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GLsizeiptr bytes = NUM_STREAM_BUFFERS * m_streamCapacity * sizeof(RenderVertex);
+            glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+            m_mapped = (RenderVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+        } else {
+            m_verts.resize(m_streamCapacity);
+        }
+        m_curBuffer = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_staticDirty = false;
+    GL_ASSERT();
+}
+
+RenderVertex* ClothRenderer::BeginFrame()
+{
+    if (!m_persistent) return m_verts.data();
+
+    // Only blocks if the GPU is still reading the frame from NUM_STREAM_BUFFERS ago
+    GLsync& fence = m_fences[m_curBuffer];
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    return m_mapped + m_curBuffer * m_streamCapacity;
+}
+
+void ClothRenderer::EndFrame()
+{
+    if (!m_persistent) return;
+
+    m_fences[m_curBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_curBuffer = (m_curBuffer + 1) % NUM_STREAM_BUFFERS;
+}
+
+void ClothRenderer::Draw(const std::vector<f3vec>& pos, DrawMode drawMode)
+{
+    if (!m_glInited) InitGL();
+    if (m_staticDirty) UploadStatic();
+
+    // Compute this frame's vertices straight into GPU-visible memory
+    size_t numVerts = (size_t)m_nx * m_ny;
+    RenderVertex* verts = BeginFrame();
+    PrepareRenderVertices(pos.data(), m_nx, m_ny, verts);
+
+    size_t base = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, m_streamVBO);
+    if (m_persistent)
+        base = m_curBuffer * m_streamCapacity * sizeof(RenderVertex);
+    else
+        glBufferData(GL_ARRAY_BUFFER, numVerts * sizeof(RenderVertex), verts, GL_STREAM_DRAW); // Orphan the old storage
+
+    const GLsizei stride = sizeof(RenderVertex);
+    const size_t posOffset = base + offsetof(RenderVertex, pos), normalOffset = base + offsetof(RenderVertex, normal);
+
+    if (drawMode == DRAW_POINTS) {
+        glPointSize(3.0);
+        glColor3f(0, 1, 1);
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, stride, BUFFER_OFFSET(posOffset));
+        glDrawArrays(GL_POINTS, 0, (GLsizei)numVerts);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    } else if (drawMode == DRAW_LINES) {
+        glLineWidth(2.5f);
+        glColor3f(1, 1, 1);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        for (int i = 0; i < m_nx - 1; i++) {
+            glVertexPointer(3, GL_FLOAT, m_nx * stride, BUFFER_OFFSET(posOffset + i * stride));
+            glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)m_ny);
+        }
+        glDisableClientState(GL_VERTEX_ARRAY);
+    } else if (drawMode == DRAW_TRIS) {
+        glColor3f(1, 1, 1);
+        glEnable(GL_LIGHT0);
+        glEnable(GL_LIGHTING);
+        glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+        glEnable(GL_TEXTURE_2D);
+        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        glBindTexture(GL_TEXTURE_2D, m_texID);
+
+        glNormalPointer(GL_FLOAT, stride, BUFFER_OFFSET(normalOffset));
+        glVertexPointer(3, GL_FLOAT, stride, BUFFER_OFFSET(posOffset));
+        glBindBuffer(GL_ARRAY_BUFFER, m_uvVBO);
+        glTexCoordPointer(2, GL_FLOAT, 0, BUFFER_OFFSET(0));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);
+
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_VERTEX_ARRAY);
+
+        glDrawElements(GL_TRIANGLES, (GLsizei)m_triInds.size() * 3, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDisable(GL_TEXTURE_2D);
+        glDisable(GL_LIGHTING);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    EndFrame();
+    GL_ASSERT();
+}
+
+void ClothRenderer::ReadTexture(const char* texName)
+{
+    uc3Image texIm(texName);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &m_texID);
+    glBindTexture(GL_TEXTURE_2D, m_texID);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 128.0f);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, texIm.w(), texIm.h(), GL_RGB, GL_UNSIGNED_BYTE, texIm.pp());
+
+    GL_ASSERT();
+}
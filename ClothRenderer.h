@@ -0,0 +1,45 @@
+// ClothRenderer.h - Draws a cloth particle grid with OpenGL using persistent-mapped, triple-buffered vertex buffers
+
+#pragma once
+
+#include "RenderPrep.h"
+
+#include <vector>
+
+enum DrawMode { DRAW_POINTS, DRAW_LINES, DRAW_TRIS, NUM_DRAW_MODES };
+
+struct __GLsync;
+
+class ClothRenderer {
+public:
+    ClothRenderer(const char* texName = "PatternCloth.jpg");
+    ~ClothRenderer();
+    void SetTopology(int nx, int ny, const std::vector<i3vec>& triInds, const std::vector<f2vec>& texCoords); // Grid size, triangles, and UVs; these are static
+    void Draw(const std::vector<f3vec>& pos, DrawMode mode);                                                 // Upload positions and normals and emit OpenGL commands
+
+private:
+    void InitGL();
+    void UploadStatic();
+    void ReadTexture(const char*);
+    RenderVertex* BeginFrame(); // Returns where to write this frame's vertices
+    void EndFrame();            // Fence the buffer region this frame used
+
+    static const int NUM_STREAM_BUFFERS = 3; // Triple buffering lets the CPU fill one region while the GPU reads the other two
+
+    int m_nx = 0, m_ny = 0;                      // Grid points in x and y
+    std::vector<i3vec> m_triInds;                // Triangle indices
+    std::vector<f2vec> m_texCoords;              // Texture coordinates per vertex
+    const char* m_texName;                       // Texture is read when the GL context first gets used
+    bool m_glInited = false;                     // Buffers and texture have been created
+    bool m_staticDirty = true;                   // UVs and indices need to be uploaded
+    unsigned int m_texID = 0;                    // OpenGL texture ID
+    unsigned int m_streamVBO = 0;                // Per-frame positions and normals
+    unsigned int m_uvVBO = 0;                    // Static texture coordinates
+    unsigned int m_indexVBO = 0;                 // Static triangle indices
+    size_t m_streamCapacity = 0;                 // Vertices per stream region
+    bool m_persistent = false;                   // Have GL_ARB_buffer_storage; otherwise orphan and re-upload each frame
+    RenderVertex* m_mapped = nullptr;            // Persistent mapping of all NUM_STREAM_BUFFERS regions
+    __GLsync* m_fences[NUM_STREAM_BUFFERS] = {}; // Signaled when the GPU is done reading each region
+    int m_curBuffer = 0;                         // Region being written this frame
+    std::vector<RenderVertex> m_verts;           // Staging for the non-persistent fallback
+};
@@ -0,0 +1,400 @@
+// ClothSolver.cpp
+
+#include "ClothSolver.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+// Convert between float and double vectors; compiles away when the types match
+template <class To, class From> static inline To VecCast(const From& v)
+{
+    typedef decltype(To().x) T;
+    return To((T)v.x, (T)v.y, (T)v.z);
+}
+
+unsigned ClothConstraints::Features() const
+{
+    return (pins.empty() && sliders.empty() ? 0 : FEAT_PINS) | (stiffRods.empty() ? 0 : FEAT_STIFFENING);
+}
+
+void ClothConstraints::Shuffle(std::mt19937& rng)
+{
+    order.clear();
+    for (size_t i = 0; i < rods.size(); i++) order.push_back({CON_ROD, (int)i});
+    for (size_t i = 0; i < stiffRods.size(); i++) order.push_back({CON_STIFF_ROD, (int)i});
+    for (size_t i = 0; i < pins.size(); i++) order.push_back({CON_PIN, (int)i});
+    for (size_t i = 0; i < sliders.size(); i++) order.push_back({CON_SLIDER, (int)i});
+
+    // Swap each constraint with another random one. Each cloth has its own generator, so cloths on different threads don't race.
+    for (size_t i = 0; i < order.size(); i++) std::swap(order[i], order[rng() % order.size()]);
+}
+
+void ClothConstraints::Clear()
+{
+    rods.clear();
+    stiffRods.clear();
+    pins.clear();
+    sliders.clear();
+    order.clear();
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::SetConstraints(const ClothConstraints& cons)
+{
+    std::vector<ConstraintRef> order = cons.order;
+    if (order.empty()) {
+        for (size_t i = 0; i < cons.rods.size(); i++) order.push_back({CON_ROD, (int)i});
+        for (size_t i = 0; i < cons.stiffRods.size(); i++) order.push_back({CON_STIFF_ROD, (int)i});
+        for (size_t i = 0; i < cons.pins.size(); i++) order.push_back({CON_PIN, (int)i});
+        for (size_t i = 0; i < cons.sliders.size(); i++) order.push_back({CON_SLIDER, (int)i});
+    }
+
+    // Pins and sliders go in the same sequence as the rods, so rods applied after a pin in one sweep already see it in place.
+    // Features this solver wasn't compiled for are dropped, so the caller has to pick the solver from cons.Features().
+    m_rods.clear();
+    m_pins.clear();
+    for (const ConstraintRef& c : order) {
+        if (c.kind == CON_ROD || (c.kind == CON_STIFF_ROD && (F & FEAT_STIFFENING))) {
+            const RodDesc& r = c.kind == CON_ROD ? cons.rods[c.index] : cons.stiffRods[c.index];
+            m_rods.push_back({r.a, r.b, (A)r.restLen * (A)r.restLen});
+        } else if ((c.kind == CON_PIN || c.kind == CON_SLIDER) && (F & FEAT_PINS)) {
+            const PinDesc& p = c.kind == CON_PIN ? cons.pins[c.index] : cons.sliders[c.index];
+            m_rods.push_back({p.index, -1 - (int)m_pins.size(), 0});
+            m_pins.push_back({p.index, VecCast<SVec>(p.pos), p.axes});
+        }
+    }
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::Bind(std::vector<f3vec>& pos, std::vector<f3vec>& oldPos)
+{
+    m_boundPos = &pos;
+    m_boundOldPos = &oldPos;
+    if constexpr (!IN_PLACE) {
+        m_ownPos.resize(pos.size());
+        m_ownOldPos.resize(oldPos.size());
+        for (size_t i = 0; i < pos.size(); i++) m_ownPos[i] = VecCast<SVec>(pos[i]);
+        for (size_t i = 0; i < oldPos.size(); i++) m_ownOldPos[i] = VecCast<SVec>(oldPos[i]);
+    }
+    PointAtState();
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::Sync() const
+{
+    if constexpr (!IN_PLACE) {
+        for (size_t i = 0; i < m_numParticles; i++) (*m_boundPos)[i] = VecCast<f3vec>(m_ownPos[i]);
+        for (size_t i = 0; i < m_numParticles; i++) (*m_boundOldPos)[i] = VecCast<f3vec>(m_ownOldPos[i]);
+    }
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::PointAtState()
+{
+    if constexpr (IN_PLACE) {
+        m_pos = m_boundPos->data();
+        m_oldPos = m_boundOldPos->data();
+    } else {
+        m_pos = m_ownPos.data();
+        m_oldPos = m_ownOldPos.data();
+    }
+    m_numParticles = m_boundPos->size();
+}
+
+template <class S, class A, unsigned F> SolverPrecision ClothSolver<S, A, F>::Precision() const
+{
+    if (sizeof(S) == sizeof(double)) return PRECISION_DOUBLE;
+    return sizeof(A) == sizeof(double) ? PRECISION_MIXED : PRECISION_FLOAT;
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::VerletIntegration(const SolverStep& step)
+{
+    A damping = step.damping, dt2 = (A)step.timeStep * (A)step.timeStep;
+    AVec accel = VecCast<AVec>(step.gravity) * dt2;
+    const f3vec* forces = step.forces && step.forces->size() == m_numParticles ? step.forces->data() : nullptr;
+
+    ForEach(step.parallel, m_pos, m_pos + m_numParticles, [&](SVec const& p) {
+        size_t i = &p - m_pos;
+        SVec temp = m_pos[i];
+        AVec x = VecCast<AVec>(temp);
+        AVec oldx = VecCast<AVec>(m_oldPos[i]);
+        AVec a = forces ? accel + VecCast<AVec>(forces[i]) * dt2 : accel;
+
+        // Verlet integration: x - oldx is an approximation of velocity.
+        m_pos[i] = VecCast<SVec>(x + (x - oldx) * damping + a);
+        m_oldPos[i] = temp;
+    });
+}
+
+// Where a segment from a along d enters and leaves a box, as fractions of d, and through which axis' faces; false if it misses
+template <class AVec, class A> static inline bool ClipSegment(const AVec& a, const AVec& d, const AVec& lo, const AVec& hi, A& tEnter, A& tExit, int& enterAxis,
+                                                              int& exitAxis)
+{
+    tEnter = -1e30;
+    tExit = 1e30;
+    enterAxis = exitAxis = 0;
+    for (int k = 0; k < 3; k++) {
+        if (d[k] == 0) {
+            if (a[k] < lo[k] || a[k] > hi[k]) return false;
+            continue;
+        }
+        A t0 = (lo[k] - a[k]) / d[k], t1 = (hi[k] - a[k]) / d[k];
+        if (std::min(t0, t1) > tEnter) tEnter = std::min(t0, t1), enterAxis = k;
+        if (std::max(t0, t1) < tExit) tExit = std::max(t0, t1), exitAxis = k;
+    }
+    return tEnter <= tExit;
+}
+
+// Stop a path at the fraction t where it hits a surface with normal n, then let the rest of it slide along the surface
+template <class AVec, class A> static inline AVec SlideFrom(const AVec& a, const AVec& d, A t, const AVec& n)
+{
+    AVec rest = d * (1 - t);
+    A into = rest.x * n.x + rest.y * n.y + rest.z * n.z;
+    if (into < 0) rest -= n * into;
+    return a + d * t + rest;
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::Sweep(bool parallel)
+{
+    // Continuous collision, once per step. The projection inside the iterations only sees where things end up, so anything that moves
+    // farther than a collider's depth in one step passes straight through it. Here each particle's path from m_oldPos to m_pos is taken
+    // into the collider's frame, i.e. its start point is carried along by the collider's own motion, and a path that crosses the surface
+    // is stopped where it first touches and slides along the surface for the rest of the step. A start point that is already inside,
+    // usually from rounding or the rods pulling on the last step's contact, is first moved to the nearest point on the surface.
+    // Colliders only translate, so the frame change is just the shift.
+    ForEach(parallel, m_pos, m_pos + m_numParticles, [&](SVec& p) {
+        size_t i = &p - m_pos;
+        AVec x = VecCast<AVec>(p), start = VecCast<AVec>(m_oldPos[i]);
+
+        if constexpr (COLLIDER == SOLVER_COLLIDE_SPHERES) {
+            for (size_t j = 0; j < m_sphereCenters.size(); j++) {
+                AVec a = start + m_sphereShifts[j] - m_sphereCenters[j];
+                A rad = m_sphereRadii[j], aLenSqr = a.lenSqr();
+                if (aLenSqr < rad * rad && aLenSqr > 0) a *= rad / std::sqrt(aLenSqr);
+
+                // First root of |a + t d| = rad
+                AVec d = x - m_sphereCenters[j] - a;
+                A dd = d.lenSqr(), ad = a.x * d.x + a.y * d.y + a.z * d.z, c = a.lenSqr() - rad * rad, disc = ad * ad - dd * c;
+                if (ad >= 0 || disc < 0) continue;
+                A t = std::max((A)0, (-ad - std::sqrt(disc)) / dd);
+                if (t > 1) continue;
+
+                AVec n = a + d * t;
+                n *= 1 / std::sqrt(n.lenSqr());
+                x = m_sphereCenters[j] + SlideFrom(a, d, t, n);
+            }
+        } else if constexpr (COLLIDER == SOLVER_COLLIDE_BOXES) {
+            for (const Box& b : m_boxes) {
+                AVec a = start + b.shift;
+                if (a.x > b.lo.x && a.y > b.lo.y && a.z > b.lo.z && a.x < b.hi.x && a.y < b.hi.y && a.z < b.hi.z) {
+                    int axis = 0;
+                    A best = a[0] - b.lo[0], target = b.lo[0];
+                    for (int k = 0; k < 3; k++) {
+                        if (a[k] - b.lo[k] < best) best = a[k] - b.lo[k], target = b.lo[k], axis = k;
+                        if (b.hi[k] - a[k] < best) best = b.hi[k] - a[k], target = b.hi[k], axis = k;
+                    }
+                    a[axis] = target;
+                }
+
+                AVec d = x - a;
+                A tEnter, tExit;
+                int enterAxis, exitAxis;
+                if (!ClipSegment(a, d, b.lo, b.hi, tEnter, tExit, enterAxis, exitAxis) || tEnter < 0 || tEnter > 1) continue;
+
+                AVec n(0, 0, 0);
+                n[enterAxis] = d[enterAxis] > 0 ? -1 : 1;
+                x = SlideFrom(a, d, tEnter, n);
+            }
+        } else if constexpr (COLLIDER == SOLVER_COLLIDE_INSIDE_BOX) {
+            const Box& b = m_boxes[0];
+            AVec a = start + b.shift, d = x - a;
+            A tEnter, tExit;
+            int enterAxis, exitAxis;
+            if (ClipSegment(a, d, b.lo, b.hi, tEnter, tExit, enterAxis, exitAxis) && tExit < 1 && tExit >= 0) {
+                AVec n(0, 0, 0);
+                n[exitAxis] = d[exitAxis] > 0 ? -1 : 1;
+                x = SlideFrom(a, d, tExit, n);
+            }
+        }
+
+        p = VecCast<SVec>(x);
+    });
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::Collide(bool parallel, bool sweep)
+{
+    // A particle inside a collider goes to the nearest point outside, except that with sweep on, one that started this step outside and has
+    // been pulled past the middle goes back out the way it came in rather than out the far side.
+    if constexpr (COLLIDER == SOLVER_COLLIDE_SPHERES) {
+        ForEach(parallel, m_pos, m_pos + m_numParticles, [&](SVec& p) {
+            size_t i = &p - m_pos;
+            AVec x = VecCast<AVec>(p);
+            for (size_t j = 0; j < m_sphereCenters.size(); j++) {
+                AVec V = x - m_sphereCenters[j];
+                A lenSqr = V.lenSqr(), rad = m_sphereRadii[j];
+                if (lenSqr >= rad * rad) continue;
+
+                AVec a = VecCast<AVec>(m_oldPos[i]) + m_sphereShifts[j] - m_sphereCenters[j], d = V - a;
+                A c = a.lenSqr() - rad * rad, dd = d.lenSqr(), ad = a.x * d.x + a.y * d.y + a.z * d.z;
+                if (sweep && c > 0 && dd > 0 && a.x * V.x + a.y * V.y + a.z * V.z < 0)
+                    x = m_sphereCenters[j] + a + d * ((-ad - std::sqrt(std::max((A)0, ad * ad - dd * c))) / dd);
+                else
+                    x = m_sphereCenters[j] + V * (rad / std::sqrt(lenSqr));
+            }
+            p = VecCast<SVec>(x);
+        });
+    } else if constexpr (COLLIDER == SOLVER_COLLIDE_BOXES) {
+        ForEach(parallel, m_pos, m_pos + m_numParticles, [&](SVec& p) {
+            size_t i = &p - m_pos;
+            AVec x = VecCast<AVec>(p);
+            for (const Box& b : m_boxes) {
+                if (x.x < b.lo.x || x.y < b.lo.y || x.z < b.lo.z || x.x > b.hi.x || x.y > b.hi.y || x.z > b.hi.z) continue;
+
+                int axis = 0;
+                A best = x[0] - b.lo[0], target = b.lo[0];
+                for (int k = 0; k < 3; k++) {
+                    if (x[k] - b.lo[k] < best) best = x[k] - b.lo[k], target = b.lo[k], axis = k;
+                    if (b.hi[k] - x[k] < best) best = b.hi[k] - x[k], target = b.hi[k], axis = k;
+                }
+
+                AVec a = VecCast<AVec>(m_oldPos[i]) + b.shift, d = x - a;
+                A tEnter, tExit;
+                int enterAxis, exitAxis;
+                if (sweep && ClipSegment(a, d, b.lo, b.hi, tEnter, tExit, enterAxis, exitAxis) && tEnter >= 0 && enterAxis == axis) {
+                    A entryFace = d[axis] > 0 ? b.lo[axis] : b.hi[axis];
+                    target = entryFace; // Past the middle, so the nearest face is the far one
+                }
+                x[axis] = target;
+            }
+            p = VecCast<SVec>(x);
+        });
+    } else if constexpr (COLLIDER == SOLVER_COLLIDE_INSIDE_BOX) {
+        // If the particle is outside the box pull it to the nearest point on the box surface; nothing can tunnel out of a box that's just a clamp
+        const Box& b = m_boxes[0];
+        ForEach(parallel, m_pos, m_pos + m_numParticles, [&](SVec& p) {
+            AVec x = VecCast<AVec>(p);
+            for (int k = 0; k < 3; k++) x[k] = std::min(std::max(x[k], b.lo[k]), b.hi[k]);
+            p = VecCast<SVec>(x);
+        });
+    }
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::ApplyConstraints(bool parallel)
+{
+    // This parallelization has a race condition, since multiple threads could touch the same particle at the same time,
+    // but in practice it just doesn't matter.
+    ForEach(parallel, m_rods.begin(), m_rods.end(), [&](const Rod& r) {
+        if constexpr (HAS_PINS)
+            if (r.b < 0) {
+                ApplyPin(m_pins[-1 - r.b]);
+                return;
+            }
+
+        AVec pa = VecCast<AVec>(m_pos[r.a]), pb = VecCast<AVec>(m_pos[r.b]);
+        AVec delta = pb - pa;
+
+        // Faster than normalizing because no sqrt, but a bit less accurate
+        A halfDiff = -(r.restLenSqr / (delta.lenSqr() + r.restLenSqr) - (A)0.5);
+        delta *= halfDiff;
+        m_pos[r.a] = VecCast<SVec>(pa + delta);
+        m_pos[r.b] = VecCast<SVec>(pb - delta);
+    });
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::ApplyPin(const Pin& p)
+{
+    if (p.axes == (CX_AXIS | CY_AXIS | CZ_AXIS)) {
+        m_pos[p.index] = p.pos; // Plain pins and grabs
+        return;
+    }
+    if (p.axes & CX_AXIS) m_pos[p.index].x = p.pos.x;
+    if (p.axes & CY_AXIS) m_pos[p.index].y = p.pos.y;
+    if (p.axes & CZ_AXIS) m_pos[p.index].z = p.pos.z;
+}
+
+template <class S, class A, unsigned F> void ClothSolver<S, A, F>::Step(const SolverStep& step, SolverIterationHook* hook)
+{
+    PointAtState(); // In case the bound vectors were reallocated
+    // Colliders are converted once per step rather than once per particle per iteration
+    if constexpr (COLLIDER == SOLVER_COLLIDE_SPHERES) {
+        m_sphereCenters.resize(step.spheres->size());
+        m_sphereRadii.resize(step.spheres->size());
+        m_sphereShifts.resize(step.spheres->size());
+        bool hasPrev = step.prevSpheres && step.prevSpheres->size() == step.spheres->size();
+        for (size_t j = 0; j < step.spheres->size(); j++) {
+            const f4vec& s = (*step.spheres)[j];
+            m_sphereCenters[j] = AVec(s.x, s.y, s.z);
+            m_sphereRadii[j] = s.w;
+            m_sphereShifts[j] = hasPrev ? m_sphereCenters[j] - VecCast<AVec>(f3vec((*step.prevSpheres)[j])) : AVec(0, 0, 0);
+        }
+    } else if constexpr (COLLIDER == SOLVER_COLLIDE_BOXES || COLLIDER == SOLVER_COLLIDE_INSIDE_BOX) {
+        size_t st = COLLIDER == SOLVER_COLLIDE_INSIDE_BOX ? 0 : 1, end = COLLIDER == SOLVER_COLLIDE_INSIDE_BOX ? 1 : step.boxes->size();
+        bool hasPrev = step.prevBoxes && step.prevBoxes->size() == step.boxes->size();
+        m_boxes.clear();
+        for (size_t j = st; j < end && j < step.boxes->size(); j++) {
+            AVec c = VecCast<AVec>((*step.boxes)[j].centroid()), h = VecCast<AVec>((*step.boxes)[j].extent()) * (A)0.5;
+            AVec shift = hasPrev ? c - VecCast<AVec>((*step.prevBoxes)[j].centroid()) : AVec(0, 0, 0);
+            m_boxes.push_back({c - h, c + h, shift});
+        }
+        if (COLLIDER == SOLVER_COLLIDE_INSIDE_BOX && m_boxes.empty()) m_boxes.push_back({AVec(-1e30, -1e30, -1e30), AVec(1e30, 1e30, 1e30), AVec(0, 0, 0)});
+    }
+
+    m_grabs.clear();
+    if (step.grabs)
+        for (const GrabPin& g : *step.grabs) m_grabs.push_back({g.index, VecCast<SVec>(g.pos), CX_AXIS | CY_AXIS | CZ_AXIS});
+
+    VerletIntegration(step);
+    if constexpr (COLLIDER != SOLVER_COLLIDE_NONE)
+        if (step.sweep) Sweep(step.parallel);
+
+    // Apply all the constraints several times per time step to try to find a mutually satisfactory position for each particle
+    // More iterations makes the simulation much more accurate, such as making the cloth pleat properly.
+    for (int j = 0; j < step.iters; j++) {
+        if constexpr (COLLIDER != SOLVER_COLLIDE_NONE) Collide(step.parallel, step.sweep);
+
+        ApplyConstraints(step.parallel);
+        for (const Pin& g : m_grabs) ApplyPin(g); // After everything else, so the grabbed particles end up exactly where they're held
+
+        if (hook) hook->AfterIteration(m_pos, sizeof(SVec));
+    }
+}
+
+// Every combination of precision and feature mask is compiled here, and MakeClothSolver() indexes into the table
+#define SOLVER_INST4(S, A, F)                       \
+    template class ClothSolver<S, A, F + 0>;        \
+    template class ClothSolver<S, A, F + 1>;        \
+    template class ClothSolver<S, A, F + 2>;        \
+    template class ClothSolver<S, A, F + 3>
+#define SOLVER_INST16(S, A)                         \
+    SOLVER_INST4(S, A, 0);                          \
+    SOLVER_INST4(S, A, 4);                          \
+    SOLVER_INST4(S, A, 8);                          \
+    SOLVER_INST4(S, A, 12)
+
+SOLVER_INST16(float, float);
+SOLVER_INST16(double, double);
+SOLVER_INST16(float, double);
+
+typedef ClothSolverBase* (*SolverMaker)();
+
+template <class S, class A, unsigned F> static ClothSolverBase* NewSolver() { return new ClothSolver<S, A, F>; }
+
+template <class S, class A, unsigned... Fs> static const SolverMaker* SolverTable(std::integer_sequence<unsigned, Fs...>)
+{
+    static const SolverMaker table[] = {&NewSolver<S, A, Fs>...};
+    return table;
+}
+
+ClothSolverBase* MakeClothSolver(SolverPrecision precision, unsigned features)
+{
+    typedef std::make_integer_sequence<unsigned, NUM_SOLVER_FEATURE_SETS> AllFeatures;
+
+    if (features >= NUM_SOLVER_FEATURE_SETS) {
+        printf("ERROR: bad solver feature mask %u\n", features);
+        exit(1);
+    }
+
+    if (precision == PRECISION_DOUBLE) return SolverTable<double, double>(AllFeatures())[features]();
+    if (precision == PRECISION_MIXED) return SolverTable<float, double>(AllFeatures())[features]();
+    return SolverTable<float, float>(AllFeatures())[features]();
+}
@@ -0,0 +1,161 @@
+// ClothSolver.h - The time step hot loops, compiled separately for each precision and each set of constraints and colliders in use
+// Constraints are plain index-based arrays rather than virtual objects, and the collider kind, stiffening, and whether there are pins at all
+// are resolved at compile time, so a cloth without pins gets branch-free, fully inlined loops. Pins and sliders are applied in the same
+// shuffled order as the rods, so with them each constraint is tested for being one. MakeClothSolver() picks the right one at run time.
+
+#pragma once
+
+#include "Math/AABB.h"
+
+#include <random>
+#include <type_traits>
+#include <vector>
+
+enum SolverPrecision { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_MIXED, NUM_SOLVER_PRECISIONS }; // Mixed stores floats but does the math in double
+
+// Feature mask bits; FEAT_PINS covers sliders too, and the collider kind is a two-bit field since only one kind is active at a time
+enum SolverFeatures { FEAT_PINS = 1, FEAT_STIFFENING = 2, FEAT_COLLIDER_SHIFT = 2, NUM_SOLVER_FEATURE_SETS = 16 };
+enum SolverCollider { SOLVER_COLLIDE_NONE, SOLVER_COLLIDE_SPHERES, SOLVER_COLLIDE_BOXES, SOLVER_COLLIDE_INSIDE_BOX };
+
+// Constrain particle in some axes but allow movement in others
+enum ConstrainAxis { CX_AXIS = 1, CY_AXIS = 2, CZ_AXIS = 4 };
+
+// Constrain two particles to a specific distance from each other
+struct RodDesc {
+    int a, b;
+    float restLen;
+};
+
+// Constrain particle to specific point, or only some of its axes to that point
+struct PinDesc {
+    int index;
+    f3vec pos;
+    int axes; // ConstrainAxis bits; all three for a plain pin
+};
+
+enum ConstraintKind { CON_ROD, CON_STIFF_ROD, CON_PIN, CON_SLIDER };
+
+// One entry of ClothConstraints::order
+struct ConstraintRef {
+    int kind;  // ConstraintKind
+    int index; // Into the vector of that kind
+};
+
+// All the constraints of a cloth, grouped by kind, and the order they're applied in
+struct ClothConstraints {
+    std::vector<RodDesc> rods;        // Structural and shear rods
+    std::vector<RodDesc> stiffRods;   // Stiffening rods spanning several particles
+    std::vector<PinDesc> pins;        // Fully pinned particles
+    std::vector<PinDesc> sliders;     // Particles pinned in only some axes
+    std::vector<ConstraintRef> order; // Every constraint above; if it's empty they're applied a kind at a time, in the order above
+
+    unsigned Features() const;       // The constraint bits of the feature mask
+    void Shuffle(std::mt19937& rng); // Set order to all the constraints in random order, so they don't all pull the same way in one sweep
+    void Clear();
+};
+
+// A particle held in place by a mouse grab
+struct GrabPin {
+    int index;
+    f3vec pos;
+};
+
+// Everything that can change from one time step to the next
+struct SolverStep {
+    float timeStep;                        // Time step
+    float damping;                         // Verlet damping
+    f3vec gravity;                         // Only force
+    int iters;                             // Constraint iterations
+    bool parallel;                         // Use par_unseq for the loops
+    const std::vector<f4vec>* spheres;     // Sphere colliders, if the solver collides with spheres
+    const std::vector<Aabb>* boxes;        // Box colliders, if it collides with boxes; box 0 is the inside box
+    const std::vector<GrabPin>* grabs;     // Grabbed particles; may be null
+    bool sweep;                            // Also test each particle's path this step against the colliders' paths
+    const std::vector<f4vec>* prevSpheres; // Where the spheres were last step; same count as spheres, or null if they haven't moved
+    const std::vector<Aabb>* prevBoxes;    // Where the boxes were last step; same count as boxes, or null if they haven't moved
+    const std::vector<f3vec>* forces;      // Acceleration of each particle on top of gravity; may be null
+};
+
+// Lets a caller act between constraint iterations, e.g. to exchange boundary particles with another process
+class SolverIterationHook {
+public:
+    virtual ~SolverIterationHook() {}
+    virtual void AfterIteration(void* pos, size_t bytesPerParticle) = 0; // pos is the solver's own position array
+};
+
+class ClothSolverBase {
+public:
+    virtual ~ClothSolverBase() {}
+    virtual void SetConstraints(const ClothConstraints& cons) = 0;
+    virtual void Bind(std::vector<f3vec>& pos, std::vector<f3vec>& oldPos) = 0; // Simulate this state; keep both vectors alive and the same size while bound
+    virtual void Sync() const = 0; // Bring the bound vectors up to date. Float solvers step them in place, so only the others copy anything.
+    virtual void Step(const SolverStep& step, SolverIterationHook* hook) = 0; // Integrate and satisfy constraints
+    virtual SolverPrecision Precision() const = 0;
+    virtual unsigned Features() const = 0;
+};
+
+template <class T> struct SolverVec;
+template <> struct SolverVec<float> {
+    typedef f3vec type;
+};
+template <> struct SolverVec<double> {
+    typedef d3vec type;
+};
+
+// Store is the type positions are kept in and Accum is the type the math is done in
+template <class Store, class Accum, unsigned FeatureMask> class ClothSolver : public ClothSolverBase {
+public:
+    void SetConstraints(const ClothConstraints& cons);
+    void Bind(std::vector<f3vec>& pos, std::vector<f3vec>& oldPos);
+    void Sync() const;
+    void Step(const SolverStep& step, SolverIterationHook* hook);
+    SolverPrecision Precision() const;
+    unsigned Features() const { return FeatureMask; }
+
+private:
+    typedef typename SolverVec<Store>::type SVec;
+    typedef typename SolverVec<Accum>::type AVec;
+
+    // A rod, or a pin or slider, in the order they're applied
+    struct Rod {
+        int a, b; // b is -1 - the index in m_pins for a pin or slider
+        Accum restLenSqr;
+    };
+    struct Pin {
+        int index;
+        SVec pos;
+        int axes;
+    };
+    struct Box {
+        AVec lo, hi;
+        AVec shift; // How far the box moved since last step
+    };
+
+    static const unsigned COLLIDER = (FeatureMask >> FEAT_COLLIDER_SHIFT) & 3;
+    static const bool IN_PLACE = std::is_same<Store, float>::value; // Store matches the caller's f3vec, so step the bound state directly
+    static const bool HAS_PINS = (FeatureMask & FEAT_PINS) != 0; // m_rods holds pins and sliders, too
+
+    void PointAtState(); // Set m_pos and m_oldPos
+    void VerletIntegration(const SolverStep& step);
+    void Sweep(bool parallel);
+    void Collide(bool parallel, bool sweep);
+    void ApplyConstraints(bool parallel); // m_rods, pins and sliders included
+    void ApplyPin(const Pin& p);
+
+    std::vector<f3vec>* m_boundPos = nullptr;    // The caller's state from Bind()
+    std::vector<f3vec>* m_boundOldPos = nullptr;
+    std::vector<SVec> m_ownPos, m_ownOldPos;     // Our copy of the bound state, unless IN_PLACE
+    SVec* m_pos = nullptr;                       // Current particle positions
+    SVec* m_oldPos = nullptr;                    // Old positions
+    size_t m_numParticles = 0;
+    std::vector<Rod> m_rods;  // Every constraint in order, including stiffening rods, pins and sliders
+    std::vector<Pin> m_pins;  // Pins and sliders
+    std::vector<Pin> m_grabs; // Copied in each step
+    std::vector<AVec> m_sphereCenters;
+    std::vector<Accum> m_sphereRadii;
+    std::vector<AVec> m_sphereShifts; // How far each sphere moved since last step
+    std::vector<Box> m_boxes; // Just the boxes this solver's collider kind uses
+};
+
+// Make the solver specialized for this precision and feature mask
+ClothSolverBase* MakeClothSolver(SolverPrecision precision, unsigned features);
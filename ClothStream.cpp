@@ -0,0 +1,249 @@
+// ClothStream.cpp
+
+#include "ClothStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+enum StreamMsgType { STREAM_TOPOLOGY = 0x436c5450, STREAM_FRAME = 0x436c4652 }; // 'ClTP' and 'ClFR'
+
+// Limits a viewer checks the server's header against before allocating anything, so a corrupt or hostile one can't exhaust memory
+const int32_t STREAM_MAX_DIM = 1 << 14;    // Grid points in x or y
+const int64_t STREAM_MAX_POINTS = 1 << 24; // Grid points in all
+
+const int STREAM_ACCEPT_POLL_MS = 100; // How often the accept thread checks for shutdown
+const size_t MAX_VARINT_BYTES = 5;     // A 32-bit value in seven-bit groups
+
+struct StreamTopologyHeader {
+    uint32_t type;
+    int32_t nx, ny, numTris;
+    float quantStep;
+};
+
+struct StreamFrameHeader {
+    uint32_t type;
+    uint32_t frameNum; // Skips ahead when the server dropped frames for this viewer
+    uint32_t bytes;    // Size of the encoded frame that follows
+};
+
+// Signed values go out zigzag-coded in seven-bit groups, so small residuals take one byte
+static void PutVarint(std::vector<uint8_t>& out, int32_t v)
+{
+    uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    while (z >= 0x80) {
+        out.push_back((uint8_t)(z | 0x80));
+        z >>= 7;
+    }
+    out.push_back((uint8_t)z);
+}
+
+static bool GetVarint(const uint8_t*& p, const uint8_t* end, int32_t& v)
+{
+    uint32_t z = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end) return false;
+        uint8_t b = *p++;
+        z |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            v = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t FrameCodec::Predict(size_t i) const
+{
+    // Cloth moves smoothly, so extrapolating the last two frames usually lands within a few quanta
+    if (m_numFrames >= 2) return 2 * m_q1[i] - m_q2[i];
+    if (m_numFrames == 1) return m_q1[i];
+    return 0;
+}
+
+void FrameCodec::Encode(const std::vector<f3vec>& pos, std::vector<uint8_t>& out)
+{
+    size_t n = pos.size() * 3;
+    if (m_q1.size() != n) m_numFrames = 0;
+    m_cur.resize(n);
+    out.clear();
+
+    float invStep = 1.f / m_quantStep;
+    for (size_t i = 0; i < n; i++) {
+        m_cur[i] = (int32_t)lroundf(pos[i / 3][(int)(i % 3)] * invStep);
+        PutVarint(out, m_cur[i] - Predict(i));
+    }
+
+    // Predict from the quantized values, not the exact ones, so the decoder stays in lockstep
+    std::swap(m_q2, m_q1);
+    std::swap(m_q1, m_cur);
+    m_numFrames = std::min(m_numFrames + 1, 2);
+}
+
+bool FrameCodec::Decode(const uint8_t* data, size_t bytes, std::vector<f3vec>& pos)
+{
+    size_t n = pos.size() * 3;
+    if (m_q1.size() != n) m_numFrames = 0;
+    m_cur.resize(n);
+
+    const uint8_t *p = data, *end = data + bytes;
+    for (size_t i = 0; i < n; i++) {
+        int32_t residual;
+        if (!GetVarint(p, end, residual)) return false;
+        m_cur[i] = Predict(i) + residual;
+        pos[i / 3][(int)(i % 3)] = m_cur[i] * m_quantStep;
+    }
+
+    std::swap(m_q2, m_q1);
+    std::swap(m_q1, m_cur);
+    m_numFrames = std::min(m_numFrames + 1, 2);
+    return p == end;
+}
+
+ClothStreamServer::ClothStreamServer(int port, const StreamTopology& topo) : m_topo(topo)
+{
+    m_listener = NetListen(port, false);
+    m_acceptThread = std::thread(&ClothStreamServer::AcceptLoop, this);
+    printf("Streaming cloth on port %d\n", port);
+}
+
+ClothStreamServer::~ClothStreamServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_frameReady.notify_all();
+
+    // The accept thread polls, so it notices m_stop without relying on shutting down a listening socket, which Windows doesn't honor
+    m_acceptThread.join();
+    NetClose(m_listener);
+
+    for (auto& v : m_viewers) {
+        NetShutdown(v->sock); // In case it's stuck sending to a slow viewer
+        v->thread.join();
+        NetClose(v->sock);
+    }
+}
+
+void ClothStreamServer::Publish(const std::vector<f3vec>& pos)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_latest = pos;
+        m_frameNum++;
+        m_idleViewers = 0; // They all have a frame to send now
+    }
+    m_frameReady.notify_all();
+}
+
+void ClothStreamServer::AcceptLoop()
+{
+    while (true) {
+        SocketHandle s = NetAccept(m_listener, STREAM_ACCEPT_POLL_MS);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop) {
+            NetClose(s);
+            break;
+        }
+        if (s == INVALID_SOCKET_HANDLE) continue; // Nobody connected this time around
+
+        // Clean up after viewers that went away
+        for (size_t i = 0; i < m_viewers.size();) {
+            if (m_viewers[i]->done) {
+                m_viewers[i]->thread.join();
+                NetClose(m_viewers[i]->sock);
+                m_viewers.erase(m_viewers.begin() + i);
+            } else
+                i++;
+        }
+
+        m_viewers.emplace_back(new Viewer);
+        Viewer* v = m_viewers.back().get();
+        v->sock = s;
+        v->thread = std::thread(&ClothStreamServer::ViewerLoop, this, v);
+    }
+}
+
+void ClothStreamServer::ViewerLoop(Viewer* viewer)
+{
+    SocketHandle s = viewer->sock;
+
+    StreamTopologyHeader th = {STREAM_TOPOLOGY, m_topo.nx, m_topo.ny, (int32_t)m_topo.triInds.size(), m_topo.quantStep};
+    bool ok = NetSendAll(s, &th, sizeof(th)) && NetSendAll(s, m_topo.triInds.data(), m_topo.triInds.size() * sizeof(i3vec)) &&
+              NetSendAll(s, m_topo.texCoords.data(), m_topo.texCoords.size() * sizeof(f2vec));
+
+    FrameCodec codec(m_topo.quantStep);
+    std::vector<f3vec> pos;
+    std::vector<uint8_t> payload;
+    uint32_t lastSent = 0;
+
+    while (ok) {
+        // Take whatever frame is newest; anything published while we were sending the last one is dropped
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_frameNum == lastSent) m_idleViewers++;
+            m_frameReady.wait(lock, [&] { return m_stop || m_frameNum != lastSent; });
+            if (m_stop) break;
+            pos = m_latest;
+            lastSent = m_frameNum;
+        }
+
+        codec.Encode(pos, payload);
+        StreamFrameHeader fh = {STREAM_FRAME, lastSent, (uint32_t)payload.size()};
+        ok = NetSendAll(s, &fh, sizeof(fh)) && NetSendAll(s, payload.data(), payload.size());
+    }
+
+    viewer->done = true;
+}
+
+ClothStreamClient::~ClothStreamClient() { NetClose(m_sock); }
+
+bool ClothStreamClient::Connect(const char* host, int port)
+{
+    m_sock = NetConnect(host, port, 5000);
+    if (m_sock == INVALID_SOCKET_HANDLE) return false;
+
+    StreamTopologyHeader th;
+    if (!NetRecvAll(m_sock, &th, sizeof(th)) || th.type != STREAM_TOPOLOGY) return false;
+
+    int64_t numPoints = (int64_t)th.nx * th.ny;
+    if (th.nx < 2 || th.ny < 2 || th.nx > STREAM_MAX_DIM || th.ny > STREAM_MAX_DIM || numPoints > STREAM_MAX_POINTS || th.numTris < 0 ||
+        th.numTris > 2 * numPoints || !(th.quantStep > 0 && std::isfinite(th.quantStep))) {
+        printf("ERROR: bad cloth stream topology: %d x %d points, %d triangles\n", th.nx, th.ny, th.numTris);
+        return false;
+    }
+
+    m_topo.nx = th.nx;
+    m_topo.ny = th.ny;
+    m_topo.quantStep = th.quantStep;
+    m_topo.triInds.resize(th.numTris);
+    m_topo.texCoords.resize((size_t)th.nx * th.ny);
+    if (!NetRecvAll(m_sock, m_topo.triInds.data(), m_topo.triInds.size() * sizeof(i3vec))) return false;
+    if (!NetRecvAll(m_sock, m_topo.texCoords.data(), m_topo.texCoords.size() * sizeof(f2vec))) return false;
+
+    for (const i3vec& t : m_topo.triInds)
+        for (int k = 0; k < 3; k++)
+            if (t[k] < 0 || t[k] >= numPoints) {
+                printf("ERROR: cloth stream triangle index %d is out of range\n", t[k]);
+                return false;
+            }
+
+    m_codec.reset(new FrameCodec(m_topo.quantStep));
+    return true;
+}
+
+bool ClothStreamClient::ReceiveFrame(std::vector<f3vec>& pos, uint32_t& frameNum)
+{
+    StreamFrameHeader fh;
+    if (!NetRecvAll(m_sock, &fh, sizeof(fh)) || fh.type != STREAM_FRAME) return false;
+    if (fh.bytes > (size_t)m_topo.nx * m_topo.ny * 3 * MAX_VARINT_BYTES) return false; // Longer than any valid frame
+
+    m_payload.resize(fh.bytes);
+    if (!NetRecvAll(m_sock, m_payload.data(), m_payload.size())) return false;
+
+    pos.resize((size_t)m_topo.nx * m_topo.ny);
+    frameNum = fh.frameNum;
+    return m_codec->Decode(m_payload.data(), m_payload.size(), pos);
+}
@@ -0,0 +1,85 @@
+// ClothStream.h - Streams live cloth positions from a headless simulator to remote viewers over TCP
+// Each viewer gets the topology once. After that, each frame is quantized, and only the residuals from a linear prediction off
+// the viewer's previous two frames are sent, as variable-length integers. Every viewer has its own sender thread, which always
+// sends the newest frame and skips any it was too slow for, so a slow viewer never holds up the simulation.
+
+#pragma once
+
+#include "Math/Vector.h"
+#include "Net.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What a viewer needs to know before the first frame
+struct StreamTopology {
+    int nx = 0, ny = 0;             // Grid points in x and y
+    float quantStep = 1.f / 1024.f; // Positions are sent as multiples of this
+    std::vector<i3vec> triInds;     // Triangle indices for rendering
+    std::vector<f2vec> texCoords;   // Texture coordinates per vertex
+};
+
+// Quantizes and predicts frames; the server keeps one per viewer and the viewer keeps the matching one
+class FrameCodec {
+public:
+    FrameCodec(float quantStep) : m_quantStep(quantStep) {}
+    void Encode(const std::vector<f3vec>& pos, std::vector<uint8_t>& out);   // Replaces out with the encoded frame
+    bool Decode(const uint8_t* data, size_t bytes, std::vector<f3vec>& pos); // Returns false on a malformed frame
+
+private:
+    int32_t Predict(size_t i) const; // Prediction of quantized component i from the last two frames
+
+    float m_quantStep;
+    int m_numFrames = 0;        // Frames coded so far, up to 2
+    std::vector<int32_t> m_q1;  // Quantized components of the last frame
+    std::vector<int32_t> m_q2;  // And the one before that
+    std::vector<int32_t> m_cur; // Scratch
+};
+
+class ClothStreamServer {
+public:
+    ClothStreamServer(int port, const StreamTopology& topo); // Starts accepting viewers right away
+    ~ClothStreamServer();
+    bool WantsFrame() const { return m_idleViewers.load(std::memory_order_relaxed) > 0; } // A viewer is waiting; cheap enough to ask every step
+    void Publish(const std::vector<f3vec>& pos); // Called by the simulation when WantsFrame(); only copies pos
+
+private:
+    struct Viewer {
+        SocketHandle sock;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    void AcceptLoop();
+    void ViewerLoop(Viewer* viewer);
+
+    StreamTopology m_topo;
+    SocketHandle m_listener;
+    std::thread m_acceptThread;
+    std::vector<std::unique_ptr<Viewer>> m_viewers; // Only touched by the accept thread until shutdown
+
+    std::mutex m_mutex;                   // Guards the members below
+    std::condition_variable m_frameReady; // Signaled on each Publish()
+    std::vector<f3vec> m_latest;          // Newest published frame
+    uint32_t m_frameNum = 0;              // Number of frames published
+    bool m_stop = false;                  // Set on shutdown
+    std::atomic<int> m_idleViewers{0};    // Viewers that have sent every frame and are waiting for the next Publish()
+};
+
+class ClothStreamClient {
+public:
+    ~ClothStreamClient();
+    bool Connect(const char* host, int port);                       // Connect and receive the topology
+    const StreamTopology& Topology() const { return m_topo; }
+    bool ReceiveFrame(std::vector<f3vec>& pos, uint32_t& frameNum); // Blocks for the next frame; false if the server went away
+
+private:
+    SocketHandle m_sock = INVALID_SOCKET_HANDLE;
+    StreamTopology m_topo;
+    std::unique_ptr<FrameCodec> m_codec;
+    std::vector<uint8_t> m_payload;
+};
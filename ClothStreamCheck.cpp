@@ -0,0 +1,124 @@
+// ClothStreamCheck.cpp - Headless check that FrameCodec frames decode to within a quantization step; exits nonzero if any case fails
+
+#include "ClothStream.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static int numFailed = 0;
+
+static void Check(bool ok, const char* what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) numFailed++;
+}
+
+const float QUANT_STEP = 1.f / 1024.f;
+
+// Every component within half a step, plus the float rounding of positions that large
+static bool WithinStep(const std::vector<f3vec>& a, const std::vector<f3vec>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int k = 0; k < 3; k++)
+            if (fabsf(a[i][k] - b[i][k]) > QUANT_STEP * 0.5f + 4 * FLT_EPSILON * fabsf(a[i][k])) return false;
+    return true;
+}
+
+// An nx x ny cloth waving over time, offset so some components are negative and some need multi-byte residuals
+static std::vector<f3vec> Frame(int nx, int ny, int t, float scale = 1.f)
+{
+    std::vector<f3vec> pos((size_t)nx * ny);
+    for (int j = 0; j < ny; j++)
+        for (int i = 0; i < nx; i++)
+            pos[i + nx * j] = f3vec(i * 0.5f - 10.f, 20.f * sinf(0.3f * i + 0.1f * t) - j * 0.7f, 3.f * cosf(0.2f * j - 0.05f * t * t)) * scale;
+    return pos;
+}
+
+// Encode and decode one frame through a matching pair of codecs; returns the encoded size, or 0 if decoding failed
+static size_t RoundTrip(FrameCodec& enc, FrameCodec& dec, const std::vector<f3vec>& in, std::vector<f3vec>& out)
+{
+    std::vector<uint8_t> bytes;
+    enc.Encode(in, bytes);
+    out.resize(in.size()); // The viewer sizes the frame from the topology
+    return dec.Decode(bytes.data(), bytes.size(), out) ? bytes.size() : 0;
+}
+
+// The first frame has nothing to predict from, and later ones predict from the last two
+static void Sequence()
+{
+    FrameCodec enc(QUANT_STEP), dec(QUANT_STEP);
+    std::vector<f3vec> out;
+
+    bool ok = true;
+    for (int t = 0; t < 10; t++) {
+        std::vector<f3vec> in = Frame(17, 11, t);
+        ok = ok && RoundTrip(enc, dec, in, out) && WithinStep(in, out);
+        if (t == 0) Check(ok, "first frame round-trips");
+    }
+    Check(ok, "ten frames of motion round-trip");
+
+    // A big jump, far from any prediction, and positions large enough for four-byte residuals
+    std::vector<f3vec> in = Frame(17, 11, 10, 150.f);
+    Check(RoundTrip(enc, dec, in, out) && WithinStep(in, out), "large jump round-trips");
+    in = Frame(17, 11, 11, -150.f);
+    Check(RoundTrip(enc, dec, in, out) && WithinStep(in, out), "sign flip round-trips");
+}
+
+// A cloth moving at constant velocity is predicted exactly, so each component costs one byte
+static void LinearMotion()
+{
+    FrameCodec enc(QUANT_STEP), dec(QUANT_STEP);
+    std::vector<f3vec> base = Frame(9, 9, 0), in(base.size()), out;
+
+    size_t lastBytes = 0;
+    bool ok = true;
+    for (int t = 0; t < 4; t++) {
+        for (size_t i = 0; i < base.size(); i++) in[i] = base[i] + f3vec(1, -2, 0.5f) * (float)(t * 8);
+        lastBytes = RoundTrip(enc, dec, in, out);
+        ok = ok && lastBytes && WithinStep(in, out);
+    }
+    Check(ok, "constant velocity round-trips");
+    Check(lastBytes == in.size() * 3, "constant velocity costs one byte per component");
+}
+
+// A new grid size starts both codecs over, rather than predicting from a frame of the wrong size
+static void TopologyChange()
+{
+    FrameCodec enc(QUANT_STEP), dec(QUANT_STEP);
+    std::vector<f3vec> out;
+
+    bool ok = true;
+    for (int t = 0; t < 3; t++) {
+        std::vector<f3vec> in = Frame(12, 12, t);
+        ok = ok && RoundTrip(enc, dec, in, out) && WithinStep(in, out);
+    }
+    for (int t = 3; t < 6; t++) {
+        std::vector<f3vec> in = Frame(20, 7, t);
+        ok = ok && RoundTrip(enc, dec, in, out) && WithinStep(in, out);
+    }
+    Check(ok, "frames round-trip across a change of grid size");
+}
+
+// A truncated frame is rejected rather than decoded into garbage
+static void Truncated()
+{
+    FrameCodec enc(QUANT_STEP), dec(QUANT_STEP);
+    std::vector<f3vec> in = Frame(8, 8, 0, 150.f), out(in.size());
+    std::vector<uint8_t> bytes;
+    enc.Encode(in, bytes);
+    Check(!dec.Decode(bytes.data(), bytes.size() - 1, out), "truncated frame is rejected");
+}
+
+int main(int argc, char** argv)
+{
+    Sequence();
+    LinearMotion();
+    TopologyChange();
+    Truncated();
+
+    if (numFailed) printf("ERROR: %d cloth stream checks failed\n", numFailed);
+    return numFailed ? 1 : 0;
+}
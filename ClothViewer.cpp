@@ -0,0 +1,166 @@
+// ---------------------------------------------------
+// Cloth viewer - Displays a cloth streamed from ClothDemo -serve
+// ---------------------------------------------------
+
+#include "ClothRenderer.h"
+#include "ClothStream.h"
+#include "Util/Assert.h"
+#include "Util/Timer.h"
+
+// OpenGL
+#include "GL/glew.h"
+
+// This needs to come after GLEW
+#include "GL/freeglut.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// User Interface Globals
+int WW = 1024, WH = 1024;
+DrawMode drawMode = DRAW_TRIS;
+ClothStreamClient streamClient;
+ClothRenderer* pRenderer;
+Timer FrameRateTimer;
+
+// Shared between the receiving thread and the display
+std::mutex frameMutex;
+std::vector<f3vec> latestPos; // Newest frame received
+uint32_t latestFrameNum = 0;  // Server's frame number of latestPos
+bool serverGone = false;
+
+// Receive frames as fast as the server sends them so the server never has to drop frames on our account just because we were drawing
+void receiveLoop()
+{
+    std::vector<f3vec> pos;
+    uint32_t frameNum;
+    while (streamClient.ReceiveFrame(pos, frameNum)) {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        latestPos.swap(pos);
+        latestFrameNum = frameNum;
+    }
+
+    std::lock_guard<std::mutex> lock(frameMutex);
+    serverGone = true;
+}
+
+void userReshapeFunc0(int w, int h)
+{
+    WW = w;
+    WH = h;
+    glViewport(0, 0, w, h);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+
+    float Yfov = 45;             // VERTICAL FIELD OF VIEW IN DEGREES
+    float Aspect = w / float(h); // WIDTH OVER HEIGHT
+    float Near = 1.f;            // NEAR PLANE DISTANCE
+    float Far = 500.0f;          // FAR PLANE DISTANCE
+
+    gluPerspective(Yfov, Aspect, Near, Far);
+}
+
+// Display Function
+void userDisplayFunc0()
+{
+    static int frameCount = 0;
+    static uint32_t lastFrameNum = 0;
+    static std::vector<f3vec> pos;
+
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        if (serverGone) {
+            std::cerr << "Server went away\n";
+            exit(0);
+        }
+        if (latestPos.empty()) return;
+        pos = latestPos;
+        if (frameCount++ == 600) {
+            double time = frameCount / FrameRateTimer.Reset();
+            std::cerr << "Avg. frame rate: " << time << " Sim steps per frame: " << (latestFrameNum - lastFrameNum) / double(frameCount) << '\n';
+            lastFrameNum = latestFrameNum;
+            frameCount = 0;
+        }
+    }
+
+    // Set up view
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    f3vec LookAtCntr(0, 0, 0);
+    f3vec Eye(0, 30, 80), Up(0, 1, 0);
+    gluLookAt(Eye.x, Eye.y, Eye.z, LookAtCntr.x, LookAtCntr.y, LookAtCntr.z, Up.x, Up.y, Up.z);
+
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    pRenderer->Draw(pos, drawMode);
+    GL_ASSERT();
+
+    glutSwapBuffers();
+}
+
+void userIdleFunc0() { glutPostRedisplay(); }
+
+void userKeyboardFunc0(unsigned char Key, int x, int y)
+{
+    switch (Key) {
+    case 'w':
+        drawMode = static_cast<DrawMode>((drawMode + 1) % NUM_DRAW_MODES);
+        std::cerr << "drawMode: " << drawMode << '\n';
+        break;
+    case 'q':
+    case '\033': /* ESC key: quit */ exit(0); break;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    glutInit(&argc, argv);
+
+    const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 27400;
+    if (!streamClient.Connect(host, port)) {
+        printf("ERROR: unable to connect to %s:%d\n", host, port);
+        exit(1);
+    }
+
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH | GLUT_RGBA);
+    glutInitWindowSize(WW, WH);
+    glutInitWindowPosition(50, 50);
+    glutCreateWindow("Cloth Viewer");
+
+    GLenum glewErr = glewInit(); // Needed for the buffer objects the cloth renderer uses
+    ASSERT_R(glewErr == GLEW_OK);
+
+    glShadeModel(GL_SMOOTH);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LINE_SMOOTH);
+    glEnable(GL_POINT_SMOOTH);
+    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glutDisplayFunc(userDisplayFunc0);
+    glutIdleFunc(userIdleFunc0);
+    glutKeyboardFunc(userKeyboardFunc0);
+    glutReshapeFunc(userReshapeFunc0);
+
+    const StreamTopology& topo = streamClient.Topology();
+    pRenderer = new ClothRenderer();
+    pRenderer->SetTopology(topo.nx, topo.ny, topo.triInds, topo.texCoords);
+
+    std::thread(receiveLoop).detach();
+
+    GLfloat lightPos[] = {2.0, 30.0, 5.0, 1.0};
+
+    glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
+
+    glutMainLoop();
+
+    return 0;
+}
@@ -0,0 +1,424 @@
+// DistCloth.cpp
+
+#include "DistCloth.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <process.h>
+#include <windows.h>
+#define getpid _getpid
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+enum DistCmd { CMD_INIT, CMD_STEP, CMD_GATHER, CMD_QUIT };
+
+// The coordinator waits for the workers every this many steps, so it can't get arbitrarily far ahead of them over TCP
+const int DIST_MAX_STEPS_AHEAD = 4;
+
+// Sent to a worker before every command
+struct DistMsgHeader {
+    int cmd;          // DistCmd
+    int iters;        // Constraint iterations this step
+    int collisionObj; // CollisionObjects
+    int sweep;        // Continuous collision
+    int numSpheres;   // Colliders and grabs that follow; current and previous spheres and boxes each
+    int numBoxes;
+    int numGrabs;
+    int parallel;     // Let the worker's solver use all its cores
+    int withOldPos;   // CMD_GATHER sends old positions too
+    int ack;          // Reply when done with this CMD_STEP; CMD_QUIT always gets a reply
+    int withForces;   // CMD_STEP sends an acceleration for each held particle
+};
+
+// Which rows of the grid a worker holds
+struct SlabInfo {
+    int rowBegin, rowEnd;     // Rows this worker owns
+    int ghostBegin, ghostEnd; // Rows this worker holds, including ghost rows copied from its neighbors
+    int halo;                 // Rows exchanged with each neighbor
+    int numPins, numSliders;  // Pins and sliders that follow; they're all on the top row, so only its worker gets any
+};
+
+template <class T> static void SendVec(Transport& t, int toRank, const std::vector<T>& v)
+{
+    if (!v.empty()) t.Send(toRank, v.data(), v.size() * sizeof(T));
+}
+
+template <class T> static void RecvVec(Transport& t, int fromRank, std::vector<T>& v, size_t n)
+{
+    v.resize(n);
+    if (n) t.Recv(fromRank, v.data(), n * sizeof(T));
+}
+
+// Returns the new process's id, or its process handle on Windows
+static intptr_t SpawnProcess(const std::vector<std::string>& args)
+{
+    std::string cmdLine;
+    for (auto& a : args) cmdLine += (cmdLine.empty() ? "\"" : " \"") + a + "\"";
+
+#ifdef _WIN32
+    STARTUPINFOA si = {sizeof(si)};
+    PROCESS_INFORMATION pi;
+    if (!CreateProcessA(NULL, &cmdLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
+        printf("ERROR: unable to start [%s]\n", cmdLine.c_str());
+        exit(1);
+    }
+    CloseHandle(pi.hThread);
+    return (intptr_t)pi.hProcess;
+#else
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back((char*)a.c_str());
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+        printf("ERROR: unable to start [%s]\n", cmdLine.c_str());
+        exit(1);
+    }
+    return (intptr_t)pid;
+#endif
+}
+
+static int ProcessId(intptr_t proc)
+{
+#ifdef _WIN32
+    return (int)GetProcessId((HANDLE)proc);
+#else
+    return (int)proc;
+#endif
+}
+
+// Wait for a process that has agreed to quit, then reap it and close its handle
+static void EndProcess(intptr_t proc)
+{
+#ifdef _WIN32
+    WaitForSingleObject((HANDLE)proc, INFINITE);
+    CloseHandle((HANDLE)proc);
+#else
+    // Fails if ShmTransport already reaped it, which it does when it notices a dead worker
+    int status;
+    waitpid((pid_t)proc, &status, 0);
+#endif
+}
+
+DistCloth::DistCloth(int numWorkers, TransportKind kind, const char* exeName) : m_numWorkers(numWorkers)
+{
+    int numRanks = numWorkers + 1;
+
+    // Shared memory has to exist before the workers try to open it, and the TCP listener's port goes on their command line
+    std::string endpoint;
+    ShmTransport* shm = nullptr;
+    SocketHandle listener = INVALID_SOCKET_HANDLE;
+    if (kind == TRANSPORT_SHM) {
+        endpoint = "ClothDemo" + std::to_string(getpid());
+        m_transport.reset(shm = new ShmTransport(endpoint.c_str(), 0, numRanks, true));
+    } else {
+        int port;
+        listener = TcpTransport::Listen(port);
+        endpoint = std::to_string(port);
+    }
+
+    for (int w = 0; w < numWorkers; w++) {
+        std::string rank = std::to_string(w + 1), count = std::to_string(numWorkers);
+        m_workers.push_back(SpawnProcess({exeName, "-worker", rank, count, kind == TRANSPORT_SHM ? "shm" : "tcp", endpoint}));
+        if (shm) shm->SetPid(w + 1, ProcessId(m_workers.back())); // So we notice if it dies before opening the segment
+    }
+
+    if (kind == TRANSPORT_TCP) m_transport.reset(new TcpTransport(numRanks, listener));
+
+    printf("Simulating with %d worker processes over %s\n", numWorkers, kind == TRANSPORT_SHM ? "shared memory" : "TCP");
+}
+
+DistCloth::~DistCloth()
+{
+    // Workers handle commands in order, so each one acknowledges the quit only after it has finished every step it was sent
+    DistMsgHeader hdr = {};
+    hdr.cmd = CMD_QUIT;
+    for (int w = 0; w < m_numWorkers; w++) m_transport->Send(w + 1, &hdr, sizeof(hdr));
+    WaitForAcks();
+
+    for (intptr_t proc : m_workers) EndProcess(proc);
+}
+
+void DistCloth::WaitForAcks()
+{
+    for (int w = 0; w < m_numWorkers; w++) {
+        int cmd;
+        m_transport->Recv(w + 1, &cmd, sizeof(cmd));
+    }
+    m_stepsAhead = 0;
+}
+
+void DistCloth::Init(const DistClothParams& params, const ClothConstraints& cons, const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos)
+{
+    if (params.ny < m_numWorkers) {
+        printf("ERROR: can't split %d rows among %d workers\n", params.ny, m_numWorkers);
+        exit(1);
+    }
+
+    // Split the rows as evenly as possible
+    m_nx = params.nx;
+    m_rowStart.resize(m_numWorkers + 1);
+    int minRows = params.ny;
+    for (int w = 0; w <= m_numWorkers; w++) m_rowStart[w] = (params.ny * w) / m_numWorkers;
+    for (int w = 0; w < m_numWorkers; w++) minRows = std::min(minRows, m_rowStart[w + 1] - m_rowStart[w]);
+
+    // Ghost rows only come from adjacent workers, so a stiffening rod can't span more than one worker's slab
+    DistClothParams workerParams = params;
+    int halo = m_halo = std::max(1, std::min(params.stiffening, minRows));
+    if (params.stiffening > halo) {
+        printf("WARNING: stiffening %d is wider than a worker's slab; using %d\n", params.stiffening, halo);
+        workerParams.stiffening = halo;
+    }
+
+    for (int w = 0; w < m_numWorkers; w++) {
+        SlabInfo slab;
+        slab.rowBegin = m_rowStart[w];
+        slab.rowEnd = m_rowStart[w + 1];
+        slab.ghostBegin = std::max(0, slab.rowBegin - halo);
+        slab.ghostEnd = std::min(params.ny, slab.rowEnd + halo);
+        slab.halo = halo;
+        slab.numPins = w == 0 ? (int)cons.pins.size() : 0;
+        slab.numSliders = w == 0 ? (int)cons.sliders.size() : 0;
+
+        DistMsgHeader hdr = {};
+        hdr.cmd = CMD_INIT;
+        size_t first = (size_t)slab.ghostBegin * m_nx, count = (size_t)(slab.ghostEnd - slab.ghostBegin) * m_nx;
+        m_transport->Send(w + 1, &hdr, sizeof(hdr));
+        m_transport->Send(w + 1, &workerParams, sizeof(workerParams));
+        m_transport->Send(w + 1, &slab, sizeof(slab));
+        m_transport->Send(w + 1, pos.data() + first, count * sizeof(f3vec));
+        m_transport->Send(w + 1, oldPos.data() + first, count * sizeof(f3vec));
+        if (w == 0) {
+            SendVec(*m_transport, w + 1, cons.pins);
+            SendVec(*m_transport, w + 1, cons.sliders);
+        }
+    }
+}
+
+void DistCloth::Step(int iters, bool parallel, CollisionObjects collObj, bool sweep, const std::vector<f4vec>& spheres, const std::vector<f4vec>& prevSpheres,
+                     const std::vector<Aabb>& boxes, const std::vector<Aabb>& prevBoxes, const std::vector<GrabPin>& grabs, const std::vector<f3vec>& forces)
+{
+    bool ack = ++m_stepsAhead >= DIST_MAX_STEPS_AHEAD;
+    DistMsgHeader hdr = {CMD_STEP, iters, collObj, sweep, (int)spheres.size(), (int)boxes.size(), (int)grabs.size(), parallel, 0, ack, !forces.empty()};
+
+    // Colliders that were just added or replaced haven't moved
+    const std::vector<f4vec>& fromSpheres = prevSpheres.size() == spheres.size() ? prevSpheres : spheres;
+    const std::vector<Aabb>& fromBoxes = prevBoxes.size() == boxes.size() ? prevBoxes : boxes;
+
+    // Usually nothing comes back, so the next step can be on its way while the workers are still busy with this one
+    for (int w = 0; w < m_numWorkers; w++) {
+        m_transport->Send(w + 1, &hdr, sizeof(hdr));
+        SendVec(*m_transport, w + 1, spheres);
+        SendVec(*m_transport, w + 1, fromSpheres);
+        SendVec(*m_transport, w + 1, boxes);
+        SendVec(*m_transport, w + 1, fromBoxes);
+        SendVec(*m_transport, w + 1, grabs);
+        if (hdr.withForces) {
+            int ghostBegin = std::max(0, m_rowStart[w] - m_halo), ghostEnd = std::min(m_rowStart[m_numWorkers], m_rowStart[w + 1] + m_halo);
+            m_transport->Send(w + 1, forces.data() + (size_t)ghostBegin * m_nx, (size_t)(ghostEnd - ghostBegin) * m_nx * sizeof(f3vec));
+        }
+    }
+    if (ack) WaitForAcks();
+}
+
+void DistCloth::Gather(std::vector<f3vec>& pos, std::vector<f3vec>* oldPos)
+{
+    DistMsgHeader hdr = {};
+    hdr.cmd = CMD_GATHER;
+    hdr.withOldPos = oldPos != nullptr;
+    for (int w = 0; w < m_numWorkers; w++) m_transport->Send(w + 1, &hdr, sizeof(hdr));
+
+    for (int w = 0; w < m_numWorkers; w++) {
+        size_t first = (size_t)m_rowStart[w] * m_nx, bytes = (size_t)(m_rowStart[w + 1] - m_rowStart[w]) * m_nx * sizeof(f3vec);
+        m_transport->Recv(w + 1, pos.data() + first, bytes);
+        if (oldPos) m_transport->Recv(w + 1, oldPos->data() + first, bytes);
+    }
+    m_stepsAhead = 0; // The positions came back, so the workers have caught up
+}
+
+// The part of the cloth one worker simulates
+class ClothSlab : public SolverIterationHook {
+public:
+    void Init(const DistClothParams& params, const SlabInfo& slab, const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos,
+              const std::vector<PinDesc>& pins, const std::vector<PinDesc>& sliders);
+    void Step(const DistMsgHeader& hdr, const std::vector<f4vec>& spheres, const std::vector<f4vec>& prevSpheres, const std::vector<Aabb>& boxes,
+              const std::vector<Aabb>& prevBoxes, const std::vector<GrabPin>& grabs, const std::vector<f3vec>& forces, Transport& transport, int rank,
+              int numWorkers);
+    void AfterIteration(void* pos, size_t bytesPerParticle); // Exchange ghost rows with the neighbors
+    f3vec* Row(int row) { return m_pos.data() + (size_t)(row - m_slab.ghostBegin) * m_params.nx; } // Takes a row number of the whole grid
+    f3vec* OldRow(int row) { return m_oldPos.data() + (size_t)(row - m_slab.ghostBegin) * m_params.nx; }
+    size_t NumHeld() const { return m_pos.size(); }
+    size_t OwnedBytes() const { return (size_t)(m_slab.rowEnd - m_slab.rowBegin) * m_params.nx * sizeof(f3vec); }
+    int RowBegin() const { return m_slab.rowBegin; }
+    void Sync() { if (m_solver) m_solver->Sync(); } // Bring m_pos and m_oldPos up to date; the solver only writes them itself if it's float
+
+private:
+    void RebuildSolver(int collisionObj);
+
+    DistClothParams m_params;
+    SlabInfo m_slab;
+    std::vector<f3vec> m_pos;                  // Positions of owned and ghost rows; the solver's state while it's bound
+    std::vector<f3vec> m_oldPos;               // Old positions of owned and ghost rows
+    ClothConstraints m_constraints;            // Every constraint touching a held particle
+    std::vector<GrabPin> m_grabs;              // Grabs of held particles, indexed within the slab
+    std::unique_ptr<ClothSolverBase> m_solver; // Specialized for the collider kind the coordinator last asked for
+    int m_collisionObj = -1;                   // CollisionObjects m_solver was made for
+
+    // Where to exchange halos during Step()
+    Transport* m_transport = nullptr;
+    int m_rank = 0, m_numWorkers = 0;
+};
+
+void ClothSlab::Init(const DistClothParams& params, const SlabInfo& slab, const std::vector<f3vec>& pos, const std::vector<f3vec>& oldPos,
+                     const std::vector<PinDesc>& pins, const std::vector<PinDesc>& sliders)
+{
+    m_params = params;
+    m_slab = slab;
+    m_pos = pos;
+    m_oldPos = oldPos;
+
+    // Constraints that straddle a slab boundary exist on both sides and each applies them in full; the ghost rows are then
+    // overwritten by their owner's values after every iteration, so only the owner's result survives
+    m_constraints.Clear();
+    AddGridConstraints(m_constraints, m_params.nx, m_slab.ghostEnd - m_slab.ghostBegin, m_params.dx, m_params.dy, m_params.stiffening);
+
+    // Pins come from the coordinator, since pos may be mid-simulation; they're all on the top row, where slab and grid indices match
+    m_constraints.pins = pins;
+    m_constraints.sliders = sliders;
+    std::mt19937 rng(m_params.seed);
+    m_constraints.Shuffle(rng);
+
+    m_solver.reset();
+    m_collisionObj = -1;
+}
+
+void ClothSlab::RebuildSolver(int collisionObj)
+{
+    Sync();
+    m_collisionObj = collisionObj;
+    m_solver.reset(MakeClothSolver(m_params.precision, ClothSolverFeatures(m_constraints, (CollisionObjects)collisionObj)));
+    m_solver->SetConstraints(m_constraints);
+    m_solver->Bind(m_pos, m_oldPos);
+}
+
+void ClothSlab::Step(const DistMsgHeader& hdr, const std::vector<f4vec>& spheres, const std::vector<f4vec>& prevSpheres, const std::vector<Aabb>& boxes,
+                     const std::vector<Aabb>& prevBoxes, const std::vector<GrabPin>& grabs, const std::vector<f3vec>& forces, Transport& transport, int rank,
+                     int numWorkers)
+{
+    if (!m_solver || hdr.collisionObj != m_collisionObj) RebuildSolver(hdr.collisionObj);
+
+    int firstHeld = m_slab.ghostBegin * m_params.nx, endHeld = m_slab.ghostEnd * m_params.nx;
+    m_grabs.clear();
+    for (auto& g : grabs)
+        if (g.index >= firstHeld && g.index < endHeld) m_grabs.push_back({g.index - firstHeld, g.pos});
+
+    m_transport = &transport;
+    m_rank = rank;
+    m_numWorkers = numWorkers;
+
+    // Ghost rows integrate exactly like their owners do, so they start each step consistent
+    SolverStep step = {m_params.timeStep, m_params.damping, m_params.gravity, hdr.iters, hdr.parallel != 0, &spheres, &boxes, &m_grabs, hdr.sweep != 0,
+                       &prevSpheres, &prevBoxes, forces.empty() ? nullptr : &forces};
+    m_solver->Step(step, this);
+}
+
+void ClothSlab::AfterIteration(void* pos, size_t bytesPerParticle)
+{
+    // The boundary between worker w and w + 1 is exchanged in phase w % 2, so each worker talks to one neighbor at a time.
+    // The lower worker sends first and the upper one receives first, so blocking transports can't deadlock.
+    // Rows go over in the solver's own precision; every worker uses the same one.
+    int w = m_rank - 1;
+    size_t rowBytes = (size_t)m_params.nx * bytesPerParticle, haloBytes = m_slab.halo * rowBytes;
+    auto row = [&](int r) { return (char*)pos + (r - m_slab.ghostBegin) * rowBytes; };
+
+    for (int phase = 0; phase < 2; phase++) {
+        if (w + 1 < m_numWorkers && w % 2 == phase) {
+            m_transport->Send(m_rank + 1, row(m_slab.rowEnd - m_slab.halo), haloBytes);
+            m_transport->Recv(m_rank + 1, row(m_slab.rowEnd), haloBytes);
+        }
+        if (w > 0 && (w - 1) % 2 == phase) {
+            m_transport->Recv(m_rank - 1, row(m_slab.rowBegin - m_slab.halo), haloBytes);
+            m_transport->Send(m_rank - 1, row(m_slab.rowBegin), haloBytes);
+        }
+    }
+}
+
+int RunClothWorker(int argc, char** argv)
+{
+    if (argc < 6) {
+        printf("Usage: %s -worker <rank> <numWorkers> shm|tcp <shmName|coordinatorPort>\n", argv[0]);
+        return 1;
+    }
+
+    int rank = atoi(argv[2]), numWorkers = atoi(argv[3]), numRanks = numWorkers + 1;
+
+    // Ctrl-C in a terminal goes to the whole process group, but workers should only quit when the coordinator says so
+    signal(SIGINT, SIG_IGN);
+
+    std::unique_ptr<Transport> transport;
+    if (!strcmp(argv[4], "tcp")) {
+        std::vector<int> peers;
+        if (rank > 1) peers.push_back(rank - 1);
+        if (rank < numWorkers) peers.push_back(rank + 1);
+        transport.reset(new TcpTransport(rank, numRanks, atoi(argv[5]), peers));
+    } else {
+        transport.reset(new ShmTransport(argv[5], rank, numRanks, false));
+    }
+
+    ClothSlab slab;
+    std::vector<f4vec> spheres, prevSpheres;
+    std::vector<Aabb> boxes, prevBoxes;
+    std::vector<GrabPin> grabs;
+    std::vector<f3vec> forces;
+
+    while (true) {
+        DistMsgHeader hdr;
+        transport->Recv(0, &hdr, sizeof(hdr));
+
+        if (hdr.cmd == CMD_QUIT) {
+            transport->Send(0, &hdr.cmd, sizeof(hdr.cmd));
+            break;
+        }
+
+        if (hdr.cmd == CMD_INIT) {
+            DistClothParams params;
+            SlabInfo info;
+            std::vector<f3vec> pos, oldPos;
+            std::vector<PinDesc> pins, sliders;
+            transport->Recv(0, &params, sizeof(params));
+            transport->Recv(0, &info, sizeof(info));
+            size_t count = (size_t)(info.ghostEnd - info.ghostBegin) * params.nx;
+            RecvVec(*transport, 0, pos, count);
+            RecvVec(*transport, 0, oldPos, count);
+            RecvVec(*transport, 0, pins, info.numPins);
+            RecvVec(*transport, 0, sliders, info.numSliders);
+            slab.Init(params, info, pos, oldPos, pins, sliders);
+        } else if (hdr.cmd == CMD_STEP) {
+            RecvVec(*transport, 0, spheres, hdr.numSpheres);
+            RecvVec(*transport, 0, prevSpheres, hdr.numSpheres);
+            RecvVec(*transport, 0, boxes, hdr.numBoxes);
+            RecvVec(*transport, 0, prevBoxes, hdr.numBoxes);
+            RecvVec(*transport, 0, grabs, hdr.numGrabs);
+            RecvVec(*transport, 0, forces, hdr.withForces ? slab.NumHeld() : 0);
+            slab.Step(hdr, spheres, prevSpheres, boxes, prevBoxes, grabs, forces, *transport, rank, numWorkers);
+            if (hdr.ack) transport->Send(0, &hdr.cmd, sizeof(hdr.cmd));
+        } else if (hdr.cmd == CMD_GATHER) {
+            slab.Sync();
+            transport->Send(0, slab.Row(slab.RowBegin()), slab.OwnedBytes());
+            if (hdr.withOldPos) transport->Send(0, slab.OldRow(slab.RowBegin()), slab.OwnedBytes());
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+// DistCloth.h - Runs one cloth across several worker processes, each simulating a horizontal slab of particle rows
+// Each worker keeps ghost copies of its neighbors' boundary rows and refreshes them after every constraint iteration.
+// The coordinator (a Cloth in distributed mode) owns the colliders and grabs and sends them each step. Positions only come back
+// when the coordinator asks for them, so steps nobody looks at cost one small message per worker, plus a reply every few steps
+// so the coordinator can't run ahead of the workers.
+
+#pragma once
+
+#include "Cloth.h"
+#include "Transport.h"
+
+#include <memory>
+#include <vector>
+
+// Everything a worker needs to build its slab
+struct DistClothParams {
+    int nx, ny;                // Size of the whole grid
+    float dx, dy;              // Rest spacing between particles
+    float timeStep;            // Time step
+    float damping;             // Verlet damping
+    f3vec gravity;             // Only force
+    int stiffening;            // Stiffening constraint span
+    SolverPrecision precision; // Which solver the workers use
+    unsigned seed;             // The coordinator's constraint shuffle seed
+};
+
+class DistCloth {
+public:
+    DistCloth(int numWorkers, TransportKind kind, const char* exeName); // Starts worker processes and connects to them
+    ~DistCloth();                                                       // Tells the workers to quit and waits for them to finish
+    void Init(const DistClothParams& params, const ClothConstraints& cons, const std::vector<f3vec>& pos, // Partition the cloth and send out the slabs,
+              const std::vector<f3vec>& oldPos);                                                        // with the pins and sliders from cons
+    void Step(int iters, bool parallel, CollisionObjects collObj, bool sweep, const std::vector<f4vec>& spheres, const std::vector<f4vec>& prevSpheres,
+              const std::vector<Aabb>& boxes, const std::vector<Aabb>& prevBoxes, const std::vector<GrabPin>& grabs,
+              const std::vector<f3vec>& forces); // Start one time step; forces is empty or has an acceleration for every particle
+    void Gather(std::vector<f3vec>& pos, std::vector<f3vec>* oldPos); // Wait for the workers and fetch their positions, and old ones if oldPos is set
+
+private:
+    void WaitForAcks(); // Wait for every worker to reply to the last command that asked for it
+
+    int m_numWorkers;
+    int m_stepsAhead = 0;                   // Steps sent since the workers last replied
+    std::vector<intptr_t> m_workers;        // Process ids, or process handles on Windows
+    int m_nx = 0;
+    std::vector<int> m_rowStart;            // First row owned by each worker; m_rowStart[w + 1] is one past its last
+    int m_halo = 0;                         // Ghost rows each worker holds on either side of its own
+    std::unique_ptr<Transport> m_transport; // The coordinator is rank 0 and worker w is rank w + 1
+};
+
+// Entry point for a process started with -worker; returns the process exit code
+int RunClothWorker(int argc, char** argv);
@@ -0,0 +1,176 @@
+// Net.cpp
+
+#include "Net.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+typedef SOCKET NativeSocket;
+#define CLOSE_SOCKET closesocket
+#define SEND_FLAGS 0
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int NativeSocket;
+#define CLOSE_SOCKET close
+#define SEND_FLAGS MSG_NOSIGNAL // A viewer going away shouldn't kill the simulator with SIGPIPE
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+void NetInit()
+{
+#ifdef _WIN32
+    static bool inited = false;
+    if (inited) return;
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("ERROR: WSAStartup failed\n");
+        exit(1);
+    }
+    inited = true;
+#endif
+}
+
+// Small messages go out every constraint iteration, so don't let Nagle hold them back
+static void SetNoDelay(SocketHandle s)
+{
+    int one = 1;
+    setsockopt((NativeSocket)s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+SocketHandle NetListen(int port, bool loopbackOnly)
+{
+    NetInit();
+
+    NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((SocketHandle)s == INVALID_SOCKET_HANDLE) {
+        printf("ERROR: unable to create a socket to listen on port %d\n", port);
+        exit(1);
+    }
+
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 16) != 0) {
+        printf("ERROR: unable to listen on port %d\n", port);
+        exit(1);
+    }
+
+    return (SocketHandle)s;
+}
+
+int NetLocalPort(SocketHandle s)
+{
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (getsockname((NativeSocket)s, (sockaddr*)&addr, &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+SocketHandle NetAccept(SocketHandle listener, int timeoutMs)
+{
+    if (timeoutMs >= 0) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET((NativeSocket)listener, &readable);
+        timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        if (select((int)listener + 1, &readable, nullptr, nullptr, &tv) <= 0) return INVALID_SOCKET_HANDLE;
+    }
+
+    NativeSocket s = accept((NativeSocket)listener, nullptr, nullptr);
+    if ((SocketHandle)s == INVALID_SOCKET_HANDLE) return INVALID_SOCKET_HANDLE;
+
+    SetNoDelay((SocketHandle)s);
+    return (SocketHandle)s;
+}
+
+SocketHandle NetConnect(const char* host, int port, int timeoutMs)
+{
+    NetInit();
+
+    addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char portStr[16];
+    snprintf(portStr, sizeof(portStr), "%d", port);
+    if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+        printf("ERROR: unable to resolve %s\n", host);
+        return INVALID_SOCKET_HANDLE;
+    }
+
+    // The other process may not have started listening yet, so retry for a while
+    auto start = std::chrono::steady_clock::now();
+    SocketHandle result = INVALID_SOCKET_HANDLE;
+    while (result == INVALID_SOCKET_HANDLE) {
+        NativeSocket s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if ((SocketHandle)s == INVALID_SOCKET_HANDLE) break;
+        if (connect(s, res->ai_addr, (socklen_t)res->ai_addrlen) == 0) {
+            result = (SocketHandle)s;
+            break;
+        }
+        CLOSE_SOCKET(s);
+
+        if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeoutMs)) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    freeaddrinfo(res);
+
+    if (result != INVALID_SOCKET_HANDLE) SetNoDelay(result);
+    return result;
+}
+
+bool NetSendAll(SocketHandle s, const void* data, size_t bytes)
+{
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        int chunk = (int)(bytes < (1 << 30) ? bytes : (1 << 30));
+        int sent = (int)send((NativeSocket)s, p, chunk, SEND_FLAGS);
+        if (sent <= 0) return false;
+        p += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+bool NetRecvAll(SocketHandle s, void* data, size_t bytes)
+{
+    char* p = (char*)data;
+    while (bytes > 0) {
+        int chunk = (int)(bytes < (1 << 30) ? bytes : (1 << 30));
+        int got = (int)recv((NativeSocket)s, p, chunk, 0);
+        if (got <= 0) return false;
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+void NetShutdown(SocketHandle s)
+{
+#ifdef _WIN32
+    if (s != INVALID_SOCKET_HANDLE) shutdown((NativeSocket)s, SD_BOTH);
+#else
+    if (s != INVALID_SOCKET_HANDLE) shutdown((NativeSocket)s, SHUT_RDWR);
+#endif
+}
+
+void NetClose(SocketHandle s)
+{
+    if (s != INVALID_SOCKET_HANDLE) CLOSE_SOCKET((NativeSocket)s);
+}
@@ -0,0 +1,19 @@
+// Net.h - Minimal blocking TCP sockets for talking between cloth processes
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef intptr_t SocketHandle; // Big enough for a Windows SOCKET or a POSIX file descriptor
+const SocketHandle INVALID_SOCKET_HANDLE = -1;
+
+void NetInit();                                                     // Start up the socket library; safe to call more than once
+SocketHandle NetListen(int port, bool loopbackOnly);                // Listen on port, or on any free port if it's 0; exits on failure
+int NetLocalPort(SocketHandle s);                                   // The port a listener ended up on
+SocketHandle NetAccept(SocketHandle listener, int timeoutMs = -1);  // Block until a client connects or timeoutMs passes, if it's >= 0
+SocketHandle NetConnect(const char* host, int port, int timeoutMs); // Keep trying until the listener is up or timeoutMs passes
+bool NetSendAll(SocketHandle s, const void* data, size_t bytes);    // Returns false if the connection dropped
+bool NetRecvAll(SocketHandle s, void* data, size_t bytes);          // Returns false if the connection dropped
+void NetShutdown(SocketHandle s);                                   // Wake up any thread blocked on s
+void NetClose(SocketHandle s);
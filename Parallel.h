@@ -0,0 +1,15 @@
+// Parallel.h - The one switch between parallel and serial loops, shared by the solver and the level of detail reconstruction
+
+#pragma once
+
+#include <algorithm>
+#include <execution>
+
+// Run f on each element, in parallel unless the cloth has been told to stay on one thread
+template <class It, class F> inline void ForEach(bool parallel, It first, It last, F f)
+{
+    if (parallel)
+        std::for_each(std::execution::par_unseq, first, last, f);
+    else
+        std::for_each(first, last, f);
+}
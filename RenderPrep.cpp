@@ -0,0 +1,35 @@
+// RenderPrep.cpp
+
+#include "RenderPrep.h"
+
+#include <execution>
+
+void PrepareRenderVertices(const f3vec* pos, int nx, int ny, RenderVertex* out)
+{
+    // Each vertex gathers the normals of the triangles around it, so there are no write conflicts and it parallelizes cleanly.
+    std::for_each(std::execution::par_unseq, out, out + nx * ny, [&](RenderVertex& v) {
+        int index = (int)(&v - out);
+        int i = index % nx, j = index / nx;
+
+        // Unnormalized cross products are proportional to triangle area, so summing them gives area-weighted normals
+        f3vec n(0, 0, 0);
+        for (int qj = j - 1; qj <= j; qj++) {
+            for (int qi = i - 1; qi <= i; qi++) {
+                if (qi < 0 || qj < 0 || qi >= nx - 1 || qj >= ny - 1) continue;
+
+                const f3vec& p00 = pos[qi + qj * nx];           // Quad corner    p00---p10
+                const f3vec& p10 = pos[qi + 1 + qj * nx];       //                 | \  B |
+                const f3vec& p01 = pos[qi + (qj + 1) * nx];     //                 | A  \ |
+                const f3vec& p11 = pos[qi + 1 + (qj + 1) * nx]; //                p01---p11
+                int ci = i - qi, cj = j - qj;                   // Which corner of this quad we are
+
+                if (ci == cj || ci == 0) n += cross(p11 - p01, p00 - p01); // Triangle A: p00, p01, p11
+                if (ci == cj || ci == 1) n += cross(p10 - p11, p00 - p11); // Triangle B: p00, p11, p10
+            }
+        }
+        if (n.lenSqr() > 0) n.normalize();
+
+        v.pos = pos[index];
+        v.normal = n;
+    });
+}
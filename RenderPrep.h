@@ -0,0 +1,15 @@
+// RenderPrep.h - CPU side of cloth rendering: builds the per-frame vertex stream; no OpenGL so it can run headless
+
+#pragma once
+
+#include "Math/Vector.h"
+
+// Interleaved per-frame vertex data; texture coordinates are static so they live in their own buffer
+struct RenderVertex {
+    f3vec pos;
+    f3vec normal;
+};
+
+// Fill out[nx*ny] with the particle positions and area-weighted smooth normals of an nx x ny particle grid
+// The triangulation matches the one Cloth::Reset() builds into m_triInds.
+void PrepareRenderVertices(const f3vec* pos, int nx, int ny, RenderVertex* out);
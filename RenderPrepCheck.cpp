@@ -0,0 +1,74 @@
+// RenderPrepCheck.cpp - Headless check of PrepareRenderVertices(); exits nonzero if any case fails
+
+#include "RenderPrep.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static int numFailed = 0;
+
+static void Check(bool ok, const char* what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) numFailed++;
+}
+
+static bool Near(const f3vec& a, const f3vec& b, float eps = 1e-5f) { return (a - b).length() < eps; }
+
+// A flat grid in the XY plane has the same unit ±Z normal everywhere, and positions pass straight through
+static void FlatGrid()
+{
+    const int nx = 7, ny = 5;
+    std::vector<f3vec> pos(nx * ny);
+    for (int j = 0; j < ny; j++)
+        for (int i = 0; i < nx; i++) pos[i + nx * j] = f3vec(i * 0.5f, j * 0.25f, 0);
+
+    std::vector<RenderVertex> out(nx * ny);
+    PrepareRenderVertices(pos.data(), nx, ny, out.data());
+
+    bool unitZ = true, sameSide = true, samePos = true;
+    for (int k = 0; k < nx * ny; k++) {
+        const f3vec& n = out[k].normal;
+        unitZ = unitZ && fabsf(n.length() - 1) < 1e-5f && fabsf(n.x) < 1e-5f && fabsf(n.y) < 1e-5f;
+        sameSide = sameSide && n.z * out[0].normal.z > 0;
+        samePos = samePos && out[k].pos == pos[k];
+    }
+    Check(unitZ, "flat grid normals are unit length along Z");
+    Check(sameSide, "flat grid normals all face the same way");
+    Check(samePos, "positions are copied through");
+}
+
+// One quad folded along its p00-p11 diagonal: the two vertices on the fold share both triangles and get their area-weighted average
+static void Fold()
+{
+    const int nx = 2, ny = 2;
+    f3vec p00(0, 0, 0), p10(1, 0, 2), p01(0, 1, 0), p11(1, 1, 0); // p10 lifted, so triangle B is bigger than A
+    std::vector<f3vec> pos = {p00, p10, p01, p11};
+
+    std::vector<RenderVertex> out(nx * ny);
+    PrepareRenderVertices(pos.data(), nx, ny, out.data());
+
+    // The same triangles Cloth::Reset() builds, each cross product twice its triangle's area
+    f3vec a = cross(p01 - p00, p11 - p00); // Triangle A: p00, p01, p11
+    f3vec b = cross(p11 - p00, p10 - p00); // Triangle B: p00, p11, p10
+    f3vec shared = a + b, onlyA = a, onlyB = b, unweighted = a / a.length() + b / b.length();
+    shared.normalize();
+    onlyA.normalize();
+    onlyB.normalize();
+    unweighted.normalize();
+
+    Check(Near(out[0].normal, shared) && Near(out[3].normal, shared), "fold vertices get the area-weighted normal");
+    Check(!Near(shared, unweighted, 1e-2f), "area weighting differs from a plain average in the fold case");
+    Check(Near(out[2].normal, onlyA), "vertex on only triangle A gets its normal");
+    Check(Near(out[1].normal, onlyB), "vertex on only triangle B gets its normal");
+}
+
+int main(int argc, char** argv)
+{
+    FlatGrid();
+    Fold();
+
+    if (numFailed) printf("ERROR: %d render prep checks failed\n", numFailed);
+    return numFailed ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+// Scene.cpp
+
+#include "Scene.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static const char* clothStyleNames[NUM_CLOTH_STYLES] = {"TABLECLOTH", "CURTAIN", "SLIDING_CURTAIN", "PLEATED_CURTAIN"};
+static const char* collisionObjectNames[NUM_COLLISION_OBJECTS] = {"SPHERES", "BOXES", "INSIDE_BOXES"};
+static const char* precisionNames[NUM_SOLVER_PRECISIONS] = {"FLOAT", "DOUBLE", "MIXED"};
+
+// Accept either the name or the number of an enum value
+static int ParseEnum(const std::string& val, const char** names, int count)
+{
+    for (int i = 0; i < count; i++)
+        if (val == names[i]) return i;
+    char* end;
+    long v = strtol(val.c_str(), &end, 10);
+    return (*end == '\0' && v >= 0 && v < count) ? (int)v : -1;
+}
+
+static bool ParseFloat(const std::string& val, float& f)
+{
+    char* end;
+    f = strtof(val.c_str(), &end);
+    return !val.empty() && *end == '\0';
+}
+
+static bool ParseInt(const std::string& val, int& i)
+{
+    char* end;
+    i = (int)strtol(val.c_str(), &end, 10);
+    return !val.empty() && *end == '\0';
+}
+
+// Set one single-valued setting
+static bool SetSceneValue(Scene& scene, const std::string& key, const std::string& val)
+{
+    int e;
+    if (key == "name") {
+        scene.name = val;
+        return true;
+    }
+    if (key == "nParticlesXY") return ParseInt(val, scene.nParticlesXY) && scene.nParticlesXY > 1;
+    if (key == "clothWidth") return ParseFloat(val, scene.clothWidth) && scene.clothWidth > 0;
+    if (key == "dt") return ParseFloat(val, scene.dt) && scene.dt > 0;
+    if (key == "damping") return ParseFloat(val, scene.damping);
+    if (key == "constraintIters") return ParseInt(val, scene.constraintIters) && scene.constraintIters >= 0;
+    if (key == "stiffening") return ParseInt(val, scene.stiffening) && scene.stiffening >= 1;
+    if (key == "steps") return ParseInt(val, scene.steps) && scene.steps >= 0;
+    if (key == "lodStride") return ParseInt(val, scene.lodStride) && scene.lodStride >= 1;
+    if (key == "measurePenetration") return ParseInt(val, scene.measurePenetration) && (scene.measurePenetration == 0 || scene.measurePenetration == 1);
+    if (key == "sweptCollision") return ParseInt(val, scene.sweptCollision) && (scene.sweptCollision == 0 || scene.sweptCollision == 1);
+    if (key == "clothStyle") {
+        if ((e = ParseEnum(val, clothStyleNames, NUM_CLOTH_STYLES)) < 0) return false;
+        scene.clothStyle = (ClothStyle)e;
+        return true;
+    }
+    if (key == "collisionObjects") {
+        if ((e = ParseEnum(val, collisionObjectNames, NUM_COLLISION_OBJECTS)) < 0) return false;
+        scene.collisionObjects = (CollisionObjects)e;
+        return true;
+    }
+    if (key == "precision") {
+        if ((e = ParseEnum(val, precisionNames, NUM_SOLVER_PRECISIONS)) < 0) return false;
+        scene.precision = (SolverPrecision)e;
+        return true;
+    }
+    return false;
+}
+
+bool ReadScenes(const char* fileName, std::vector<Scene>& scenes)
+{
+    std::ifstream in(fileName);
+    if (!in) {
+        printf("ERROR: unable to open scene [%s]\n", fileName);
+        return false;
+    }
+
+    Scene base;
+    std::vector<std::pair<std::string, std::vector<std::string>>> sweeps; // Settings with more than one value
+
+    std::string line;
+    for (int lineNum = 1; std::getline(in, line); lineNum++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::string key, tok;
+        if (!(ss >> key)) continue;
+
+        std::vector<std::string> vals;
+        while (ss >> tok) vals.push_back(tok);
+
+        bool ok = !vals.empty();
+        if (key == "sphere" || key == "box" || key == "insideBox") {
+            // Colliders take a fixed number of numbers
+            std::vector<float> v(vals.size());
+            for (size_t i = 0; i < vals.size() && ok; i++) ok = ParseFloat(vals[i], v[i]);
+            if (key == "sphere" && ok && v.size() == 4)
+                base.spheres.push_back(f4vec(v[0], v[1], v[2], v[3]));
+            else if (key != "sphere" && ok && v.size() == 6) {
+                Aabb box = {f3vec(v[0], v[1], v[2]), f3vec(v[3], v[4], v[5])};
+                if (key == "box")
+                    base.boxes.push_back(box);
+                else {
+                    base.insideBox = box;
+                    base.hasInsideBox = true;
+                }
+            } else
+                ok = false;
+        } else if (vals.size() > 1) {
+            // Check each value now so a bad one is reported with its line number
+            Scene check;
+            for (auto& v : vals) ok = ok && SetSceneValue(check, key, v);
+            if (ok) sweeps.push_back({key, vals});
+        } else if (ok) {
+            ok = SetSceneValue(base, key, vals[0]);
+        }
+
+        if (!ok) {
+            printf("ERROR: %s:%d: bad setting [%s]\n", fileName, lineNum, line.c_str());
+            return false;
+        }
+    }
+
+    // Expand the cartesian product of all swept settings, odometer style
+    std::vector<size_t> which(sweeps.size(), 0);
+    while (true) {
+        Scene s = base;
+        for (size_t k = 0; k < sweeps.size(); k++) {
+            SetSceneValue(s, sweeps[k].first, sweeps[k].second[which[k]]);
+            s.name += "_" + sweeps[k].first + "=" + sweeps[k].second[which[k]];
+        }
+        scenes.push_back(s);
+
+        size_t k = 0;
+        for (; k < sweeps.size(); k++) {
+            if (++which[k] < sweeps[k].second.size()) break;
+            which[k] = 0;
+        }
+        if (k == sweeps.size()) break;
+    }
+
+    return true;
+}
+
+Cloth* CreateCloth(const Scene& scene, unsigned seed)
+{
+    f3vec startPos(0, scene.clothWidth / 2, 0);
+    float partStep = scene.clothWidth / scene.nParticlesXY;
+    Cloth* cloth = new Cloth(scene.nParticlesXY, scene.nParticlesXY, partStep, partStep, startPos, scene.dt, scene.damping, scene.clothStyle, seed);
+    cloth->SetCollideObjectType(scene.collisionObjects);
+    cloth->SetPrecision(scene.precision);
+    cloth->SetContinuousCollision(scene.sweptCollision != 0);
+    cloth->SetConstraintIters(scene.constraintIters);
+    if (scene.stiffening > 1) cloth->SetStiffening(scene.stiffening, scene.clothStyle);
+
+    if (!scene.spheres.empty()) cloth->SetSpheres(scene.spheres);
+    if (scene.hasInsideBox || !scene.boxes.empty()) {
+        std::vector<Aabb> boxes = cloth->GetBoxes();
+        if (scene.hasInsideBox) boxes[0] = scene.insideBox;
+        if (!scene.boxes.empty()) {
+            boxes.resize(1);
+            boxes.insert(boxes.end(), scene.boxes.begin(), scene.boxes.end());
+        }
+        cloth->SetBoxes(boxes);
+    }
+    if (scene.lodStride > 1) cloth->SetLod(scene.lodStride); // Last, so the first refinement sees the colliders
+
+    return cloth;
+}
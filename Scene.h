@@ -0,0 +1,55 @@
+// Scene.h - Text description of a cloth simulation: grid size, solver parameters, and colliders
+//
+// One setting per line, as a keyword followed by its values; # starts a comment. For example:
+//     name             drape
+//     nParticlesXY     110
+//     clothWidth       60
+//     dt               0.03
+//     damping          0.95
+//     constraintIters  20 30 50             # More than one value makes a sweep over every combination
+//     stiffening       1
+//     clothStyle       TABLECLOTH           # TABLECLOTH, CURTAIN, SLIDING_CURTAIN, or PLEATED_CURTAIN
+//     collisionObjects SPHERES              # SPHERES, BOXES, or INSIDE_BOXES
+//     precision        FLOAT                # FLOAT, DOUBLE, or MIXED (float storage, double math)
+//     sweptCollision   1                    # 0 turns off continuous collision, so only end-of-step positions are tested
+//     lodStride        4                    # Simulate every 4th particle, refined near colliders, grabs, and folds; 1 simulates them all
+//     sphere           0 0 5 10             # Center and radius; any sphere lines replace the default spheres
+//     insideBox        -35 -25 -35 35 30 35 # Min and max corners of the box the cloth has to stay inside
+//     box              -15 -10 -15 15 10 15 # Min and max corners of a box to stay out of; any box lines replace the defaults
+//     steps            2000                 # Time steps for a batch run
+//     measurePenetration 1                  # Have a batch run check for particles in or through a collider after every step
+
+#pragma once
+
+#include "Cloth.h"
+
+#include <string>
+#include <vector>
+
+struct Scene {
+    std::string name = "scene";
+    int nParticlesXY = 110;                              // Num particles in each dimension
+    float clothWidth = 60.f;                             // Width of the square cloth
+    float dt = 0.03f;                                    // Time step
+    float damping = 0.95f;                               // Damping constant
+    int constraintIters = 50;                            // If it runs slow reduce constraintIters first.
+    int stiffening = 1;                                  // If > 1, add stiffening constraints that span this many particles
+    ClothStyle clothStyle = TABLECLOTH;                  // How the cloth is held up
+    CollisionObjects collisionObjects = COLLIDE_SPHERES; // Which colliders are active
+    SolverPrecision precision = PRECISION_FLOAT;         // Solver precision
+    int sweptCollision = 1;                              // Continuous collision against moving colliders
+    int lodStride = 1;                                   // Coarse grid spacing in particles for level of detail
+    int steps = 1000;                                    // Time steps for a batch run
+    int measurePenetration = 0;                          // Check penetration after every batch step; syncs the whole state each step
+
+    std::vector<f4vec> spheres; // If not empty, replaces the default spheres
+    std::vector<Aabb> boxes;    // If not empty, replaces the default outside boxes
+    bool hasInsideBox = false;  // Whether insideBox replaces the default
+    Aabb insideBox;
+};
+
+// Read a scene file and expand it into one Scene per combination of swept values; returns false on error
+bool ReadScenes(const char* fileName, std::vector<Scene>& scenes);
+
+// Make a cloth set up the way the scene says; seed goes to the cloth's own random number generator
+Cloth* CreateCloth(const Scene& scene, unsigned seed = 0);
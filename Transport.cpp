@@ -0,0 +1,329 @@
+// Transport.cpp
+
+#include "Transport.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory mailboxes need lock-free atomics");
+static_assert(std::atomic<int32_t>::is_always_lock_free, "Shared memory process ids need lock-free atomics");
+
+static int CurrentPid()
+{
+#ifdef _WIN32
+    return (int)GetCurrentProcessId();
+#else
+    return (int)getpid();
+#endif
+}
+
+static bool ProcessAlive(int pid)
+{
+#ifdef _WIN32
+    HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (h == NULL) return false;
+    bool alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+    CloseHandle(h);
+    return alive;
+#else
+    // A worker that died is a zombie until its parent reaps it, and kill() still finds zombies
+    int status;
+    if (waitpid((pid_t)pid, &status, WNOHANG) == (pid_t)pid) return false;
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+#ifndef _WIN32
+// Segments this process created. They outlive the process unless unlinked, so remove them on exit() and on SIGINT or SIGTERM too.
+static const int MAX_OWNED_SEGMENTS = 8;
+static char ownedSegments[MAX_OWNED_SEGMENTS][64];
+static struct sigaction prevSigInt, prevSigTerm;
+
+static void UnlinkOwnedSegments()
+{
+    for (int i = 0; i < MAX_OWNED_SEGMENTS; i++)
+        if (ownedSegments[i][0]) shm_unlink(ownedSegments[i]);
+}
+
+static void UnlinkOnSignal(int sig)
+{
+    UnlinkOwnedSegments();
+
+    // Hand the signal on to whoever had it before; it's blocked until we return, so it gets delivered right after
+    sigaction(sig, sig == SIGINT ? &prevSigInt : &prevSigTerm, nullptr);
+    raise(sig);
+}
+
+static void OwnSegment(const std::string& posixName, bool own)
+{
+    static bool installed = false;
+    if (!installed) {
+        installed = true;
+        atexit(UnlinkOwnedSegments);
+
+        // Leave ignored signals ignored
+        struct sigaction sa = {};
+        sa.sa_handler = UnlinkOnSignal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, nullptr, &prevSigInt);
+        sigaction(SIGTERM, nullptr, &prevSigTerm);
+        if (prevSigInt.sa_handler != SIG_IGN) sigaction(SIGINT, &sa, nullptr);
+        if (prevSigTerm.sa_handler != SIG_IGN) sigaction(SIGTERM, &sa, nullptr);
+    }
+
+    for (int i = 0; i < MAX_OWNED_SEGMENTS; i++) {
+        if (own && !ownedSegments[i][0]) {
+            snprintf(ownedSegments[i], sizeof(ownedSegments[i]), "%s", posixName.c_str());
+            return;
+        }
+        if (!own && posixName == ownedSegments[i]) {
+            ownedSegments[i][0] = 0;
+            return;
+        }
+    }
+}
+#endif
+
+const int TCP_CONNECT_TIMEOUT_MS = 30000; // How long to wait for a peer process that's still starting up
+
+// What a worker sends the coordinator when it connects
+struct TcpCheckIn {
+    int32_t rank;
+    int32_t port; // Where the worker listens for higher-ranked workers, or 0 if it has none
+};
+
+SocketHandle TcpTransport::Listen(int& port)
+{
+    SocketHandle listener = NetListen(0, true);
+    port = NetLocalPort(listener);
+    return listener;
+}
+
+TcpTransport::TcpTransport(int numRanks, SocketHandle listener) : m_rank(0), m_socks(numRanks, INVALID_SOCKET_HANDLE)
+{
+    std::vector<int32_t> ports(numRanks, 0);
+    for (int i = 1; i < numRanks; i++) {
+        SocketHandle s = NetAccept(listener, TCP_CONNECT_TIMEOUT_MS);
+        if (s == INVALID_SOCKET_HANDLE) {
+            printf("ERROR: only %d of %d workers connected\n", i - 1, numRanks - 1);
+            exit(1);
+        }
+
+        TcpCheckIn in;
+        if (!NetRecvAll(s, &in, sizeof(in)) || in.rank <= 0 || in.rank >= numRanks || m_socks[in.rank] != INVALID_SOCKET_HANDLE) {
+            printf("ERROR: rank %d got a bad handshake\n", m_rank);
+            exit(1);
+        }
+        m_socks[in.rank] = s;
+        ports[in.rank] = in.port;
+    }
+    NetClose(listener);
+
+    // Now every worker is listening, so tell them all where to find each other
+    for (int r = 1; r < numRanks; r++) Send(r, ports.data(), ports.size() * sizeof(int32_t));
+}
+
+TcpTransport::TcpTransport(int rank, int numRanks, int coordPort, const std::vector<int>& peers) : m_rank(rank), m_socks(numRanks, INVALID_SOCKET_HANDLE)
+{
+    // Listen before checking in, so the port we report is ready for lower-ranked workers as soon as they hear about it
+    int numAccept = 0;
+    for (int p : peers) numAccept += p > rank;
+    TcpCheckIn in = {rank, 0};
+    SocketHandle listener = numAccept > 0 ? Listen(in.port) : INVALID_SOCKET_HANDLE;
+
+    m_socks[0] = NetConnect("127.0.0.1", coordPort, TCP_CONNECT_TIMEOUT_MS);
+    if (m_socks[0] == INVALID_SOCKET_HANDLE) {
+        printf("ERROR: rank %d unable to connect to the coordinator on port %d\n", rank, coordPort);
+        exit(1);
+    }
+    Send(0, &in, sizeof(in));
+    std::vector<int32_t> ports(numRanks);
+    Recv(0, ports.data(), ports.size() * sizeof(int32_t));
+
+    // Connect to lower-ranked peers and accept higher-ranked ones, so every pair has exactly one connection
+    for (int p : peers) {
+        if (p <= 0 || p >= rank) continue;
+        SocketHandle s = NetConnect("127.0.0.1", ports[p], TCP_CONNECT_TIMEOUT_MS);
+        if (s == INVALID_SOCKET_HANDLE) {
+            printf("ERROR: rank %d unable to connect to rank %d\n", rank, p);
+            exit(1);
+        }
+        NetSendAll(s, &m_rank, sizeof(m_rank)); // Tell the peer who we are
+        m_socks[p] = s;
+    }
+
+    for (int i = 0; i < numAccept; i++) {
+        SocketHandle s = NetAccept(listener, TCP_CONNECT_TIMEOUT_MS);
+        int peer = -1;
+        if (s == INVALID_SOCKET_HANDLE || !NetRecvAll(s, &peer, sizeof(peer)) || peer <= rank || peer >= numRanks) {
+            printf("ERROR: rank %d got a bad handshake\n", rank);
+            exit(1);
+        }
+        m_socks[peer] = s;
+    }
+    NetClose(listener);
+}
+
+TcpTransport::~TcpTransport()
+{
+    for (auto s : m_socks) NetClose(s);
+}
+
+void TcpTransport::Send(int toRank, const void* data, size_t bytes)
+{
+    if (!NetSendAll(m_socks[toRank], data, bytes)) {
+        printf("ERROR: rank %d lost connection to rank %d\n", m_rank, toRank);
+        exit(1);
+    }
+}
+
+void TcpTransport::Recv(int fromRank, void* data, size_t bytes)
+{
+    if (!NetRecvAll(m_socks[fromRank], data, bytes)) {
+        printf("ERROR: rank %d lost connection to rank %d\n", m_rank, fromRank);
+        exit(1);
+    }
+}
+
+ShmTransport::ShmTransport(const char* name, int rank, int numRanks, bool create) : m_name(name), m_rank(rank), m_numRanks(numRanks), m_created(create)
+{
+    // The process ids go first, padded so the mailboxes stay aligned
+    size_t pidBytes = (sizeof(std::atomic<int32_t>) * numRanks + 63) & ~(size_t)63;
+    m_segBytes = pidBytes + sizeof(Mailbox) * NumBoxes(numRanks);
+
+#ifdef _WIN32
+    std::string winName = "Local\\" + m_name;
+    HANDLE h;
+    if (create)
+        h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)m_segBytes >> 32), (DWORD)m_segBytes, winName.c_str());
+    else
+        h = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, winName.c_str());
+    if (h == NULL) {
+        printf("ERROR: unable to open shared memory %s\n", winName.c_str());
+        exit(1);
+    }
+    m_handle = h;
+    m_seg = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, m_segBytes);
+#else
+    std::string posixName = "/" + m_name;
+    int fd = shm_open(posixName.c_str(), create ? (O_CREAT | O_RDWR | O_TRUNC) : O_RDWR, 0600);
+    if (fd < 0 || (create && ftruncate(fd, (off_t)m_segBytes) != 0)) {
+        printf("ERROR: unable to open shared memory %s\n", posixName.c_str());
+        exit(1);
+    }
+    if (create) OwnSegment(posixName, true);
+    void* p = mmap(nullptr, m_segBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    m_seg = p == MAP_FAILED ? nullptr : p;
+#endif
+
+    if (m_seg == nullptr) {
+        printf("ERROR: unable to map shared memory %s\n", m_name.c_str());
+        exit(1);
+    }
+    m_pids = (std::atomic<int32_t>*)m_seg;
+    m_boxes = (Mailbox*)((char*)m_seg + pidBytes);
+
+    // A freshly created segment is zeroed, but construct the atomics properly anyway
+    if (create) {
+        for (int r = 0; r < numRanks; r++) new (&m_pids[r]) std::atomic<int32_t>(0);
+        for (size_t i = 0; i < NumBoxes(numRanks); i++) new (&m_boxes[i].full) std::atomic<uint32_t>(0);
+    }
+    SetPid(rank, CurrentPid());
+}
+
+ShmTransport::~ShmTransport()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(m_seg);
+    CloseHandle((HANDLE)m_handle);
+#else
+    munmap(m_seg, m_segBytes);
+    if (m_created) {
+        shm_unlink(("/" + m_name).c_str());
+        OwnSegment("/" + m_name, false);
+    }
+#endif
+}
+
+ShmTransport::Mailbox& ShmTransport::Box(int from, int to)
+{
+    bool valid = from >= 0 && to >= 0 && from < m_numRanks && to < m_numRanks;
+    if (valid && from == 0 && to > 0) return m_boxes[(to - 1) * BOXES_PER_WORKER + BOX_FROM_COORD];
+    if (valid && to == 0 && from > 0) return m_boxes[(from - 1) * BOXES_PER_WORKER + BOX_TO_COORD];
+    if (valid && from > 0 && to == from + 1) return m_boxes[(from - 1) * BOXES_PER_WORKER + BOX_UP];
+    if (valid && to > 0 && from == to + 1) return m_boxes[(to - 1) * BOXES_PER_WORKER + BOX_DOWN];
+
+    printf("ERROR: rank %d has no mailbox to rank %d\n", from, to);
+    exit(1);
+}
+
+void ShmTransport::SetPid(int rank, int pid) { m_pids[rank].store(pid, std::memory_order_release); }
+
+void ShmTransport::WaitFor(Mailbox& box, uint32_t full, int peer)
+{
+    // Messages arrive every constraint iteration, so spin briefly before yielding.
+    // Every so often make sure there's still someone on the other end; a crashed or killed peer would leave us spinning forever.
+    for (uint32_t spin = 0; box.full.load(std::memory_order_acquire) != full; spin++) {
+        if (spin > 1000) std::this_thread::yield();
+        if ((spin & 0xffff) != 0xffff) continue;
+
+        int pid = m_pids[peer].load(std::memory_order_acquire);
+        if (pid != 0 && !ProcessAlive(pid) && box.full.load(std::memory_order_acquire) != full) {
+            printf("ERROR: rank %d is waiting on rank %d, but its process %d has exited\n", m_rank, peer, pid);
+            exit(1);
+        }
+    }
+}
+
+void ShmTransport::Send(int toRank, const void* data, size_t bytes)
+{
+    Mailbox& box = Box(m_rank, toRank);
+    const char* p = (const char*)data;
+
+    do {
+        WaitFor(box, 0, toRank); // For the receiver to empty the mailbox
+
+        size_t chunk = bytes < MAILBOX_BYTES ? bytes : MAILBOX_BYTES;
+        memcpy(box.data, p, chunk);
+        box.bytes = (uint32_t)chunk;
+        box.full.store(1, std::memory_order_release);
+        p += chunk;
+        bytes -= chunk;
+    } while (bytes > 0);
+}
+
+void ShmTransport::Recv(int fromRank, void* data, size_t bytes)
+{
+    Mailbox& box = Box(fromRank, m_rank);
+    char* p = (char*)data;
+
+    do {
+        WaitFor(box, 1, fromRank);
+
+        size_t chunk = box.bytes;
+        if (chunk > bytes) {
+            printf("ERROR: rank %d got a %d byte message from rank %d but expected %d\n", m_rank, (int)chunk, fromRank, (int)bytes);
+            exit(1);
+        }
+        memcpy(p, box.data, chunk);
+        box.full.store(0, std::memory_order_release);
+        p += chunk;
+        bytes -= chunk;
+    } while (bytes > 0);
+}
@@ -0,0 +1,71 @@
+// Transport.h - Point-to-point message passing between the ranks of a distributed cloth
+// Rank 0 is the coordinator and ranks 1..N are workers. Send and Recv block, and messages between a pair of ranks arrive in order.
+
+#pragma once
+
+#include "Net.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+enum TransportKind { TRANSPORT_SHM, TRANSPORT_TCP, NUM_TRANSPORT_KINDS };
+
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual void Send(int toRank, const void* data, size_t bytes) = 0;
+    virtual void Recv(int fromRank, void* data, size_t bytes) = 0;
+};
+
+// Connects directly to each peer over localhost TCP. Every rank listens on a free port the OS picks. Workers are told the
+// coordinator's port on their command line, check in with it, and get back the ports of the other workers.
+class TcpTransport : public Transport {
+public:
+    static SocketHandle Listen(int& port);                                              // Coordinator's listener; start the workers after this
+    TcpTransport(int numRanks, SocketHandle listener);                                  // Coordinator; blocks until every worker checks in
+    TcpTransport(int rank, int numRanks, int coordPort, const std::vector<int>& peers); // Worker; blocks until it has the coordinator and its peers
+    ~TcpTransport();
+    void Send(int toRank, const void* data, size_t bytes);
+    void Recv(int fromRank, void* data, size_t bytes);
+
+private:
+    int m_rank;
+    std::vector<SocketHandle> m_socks; // Indexed by peer rank
+};
+
+// One named shared memory segment holding each rank's process id and a single-slot mailbox each way between the coordinator and
+// each worker, and between adjacent workers. No other pairs of ranks talk, so the segment grows linearly with the number of workers.
+// A rank that waits too long on a mailbox checks that the peer process is still alive, and exits with an error if it isn't.
+class ShmTransport : public Transport {
+public:
+    ShmTransport(const char* name, int rank, int numRanks, bool create); // The coordinator creates the segment before starting workers
+    ~ShmTransport();
+    void Send(int toRank, const void* data, size_t bytes);
+    void Recv(int fromRank, void* data, size_t bytes);
+    void SetPid(int rank, int pid); // Lets the coordinator watch a worker it started before the worker opens the segment
+
+private:
+    static const size_t MAILBOX_BYTES = 1 << 18; // Larger messages get sent in pieces
+
+    struct Mailbox {
+        std::atomic<uint32_t> full; // Written by both processes, so it must be lock-free
+        uint32_t bytes;
+        char data[MAILBOX_BYTES];
+    };
+
+    // Each worker rank has four mailboxes: from the coordinator, to the coordinator, up to the next worker, and back down from it
+    enum { BOX_FROM_COORD, BOX_TO_COORD, BOX_UP, BOX_DOWN, BOXES_PER_WORKER };
+    static size_t NumBoxes(int numRanks) { return (size_t)(numRanks - 1) * BOXES_PER_WORKER; }
+    Mailbox& Box(int from, int to);
+    void WaitFor(Mailbox& box, uint32_t full, int peer); // Spin until box.full == full
+
+    std::string m_name;
+    int m_rank, m_numRanks;
+    bool m_created;
+    size_t m_segBytes;
+    void* m_seg = nullptr;                  // Start of the mapped segment
+    std::atomic<int32_t>* m_pids = nullptr; // Process id of each rank, or 0 if not known yet
+    Mailbox* m_boxes = nullptr;
+    void* m_handle = nullptr;               // File mapping handle on Windows
+};